@@ -0,0 +1,106 @@
+#pragma once
+
+#include "raylib.h"
+#include "broadphase.h"
+#include <vector>
+
+// Dynamic bounding volume tree. Leaves hold "fat" boxes, enlarged by a margin and by the predicted
+// displacement, so a body only has to be reinserted once it leaves its fat box. Inserts pick the
+// sibling that grows the tree's surface least and every change is rebalanced with rotations, which
+// keeps queries logarithmic even when tiny debris and large circles are mixed.
+class AabbTree
+{
+public:
+    float margin = 4;
+    float displacementMultiplier = 2;
+
+    // Sizes the node pool for this many leaves, so that staying within them never allocates
+    void reserve(int leafCount);
+    int createProxy(int id, const Aabb& bounds);
+    void destroyProxy(int proxy);
+    // Returns true when the proxy had left its fat box and was reinserted
+    bool moveProxy(int proxy, const Aabb& bounds, Vector2 displacement);
+
+    const Aabb& getFatBounds(int proxy) const;
+    int getId(int proxy) const;
+
+    // Calls callback(id) for every leaf whose fat box overlaps bounds, until it returns false
+    template <typename Callback>
+    void query(const Aabb& bounds, Callback callback) const;
+    // Pairs of overlapping leaves with at least one of them among queryProxies, like Box2D's move
+    // buffer. Leaves that are never queried are only found by the ones that are.
+    void findPairs(const std::vector<int>& queryProxies, std::vector<CandidatePair>& pairs);
+
+    // Quality statistics, the height and area ratio grow as the tree degrades
+    int getHeight() const;
+    int getNodeCount() const;
+    int getLeafCount() const;
+    float getAreaRatio() const;
+
+private:
+    static constexpr int NULL_NODE = -1;
+    static constexpr int STACK_CAPACITY = 256;
+
+    struct Node
+    {
+        Aabb bounds;
+        int parent;
+        int child1;
+        int child2;
+        int height;
+        int id;
+        bool queried;
+
+        bool isLeaf() const { return child1 == NULL_NODE; }
+    };
+
+    std::vector<Node> nodes;
+    int root = NULL_NODE;
+    int freeList = NULL_NODE;
+    int nodeCount = 0;
+    int leafCount = 0;
+
+    // Like query, but calls callback(node) with the leaf's node index
+    template <typename Callback>
+    void queryNodes(const Aabb& bounds, Callback callback) const;
+    int allocateNode();
+    void freeNode(int node);
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    int balance(int node);
+    void refit(int node);
+};
+
+template <typename Callback>
+void AabbTree::query(const Aabb& bounds, Callback callback) const
+{
+    queryNodes(bounds, [&](int node) { return callback(nodes[node].id); });
+}
+
+template <typename Callback>
+void AabbTree::queryNodes(const Aabb& bounds, Callback callback) const
+{
+    if (root == NULL_NODE) return;
+
+    // An AVL balanced tree never gets close to this deep
+    int stack[STACK_CAPACITY];
+    int stackSize = 0;
+    stack[stackSize++] = root;
+
+    while (stackSize > 0)
+    {
+        int index = stack[--stackSize];
+        const Node& node = nodes[index];
+        if (!AabbOverlap(node.bounds, bounds)) continue;
+
+        if (node.isLeaf())
+        {
+            if (!callback(index)) return;
+        }
+        else if (stackSize + 2 <= STACK_CAPACITY)
+        {
+            stack[stackSize++] = node.child1;
+            stack[stackSize++] = node.child2;
+        }
+    }
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// Heap allocations made through operator new by every thread since the program started. Counting
+// is a relaxed atomic increment in the replaced global operator new (see allocationcounter.cpp),
+// so the difference over a stretch of code is how often it allocated, plus whatever other threads
+// allocated meanwhile.
+long long AllocationCount();
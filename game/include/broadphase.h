@@ -0,0 +1,23 @@
+#pragma once
+
+// Shared types for the broad-phase structures. A broad-phase only ever sees integer ids and
+// bounding boxes, so it does not care how the world stores its bodies.
+
+struct CandidatePair
+{
+    int a;
+    int b;
+};
+
+struct Aabb
+{
+    float minX;
+    float minY;
+    float maxX;
+    float maxY;
+};
+
+inline bool AabbOverlap(const Aabb& a, const Aabb& b)
+{
+    return a.minX <= b.maxX && a.maxX >= b.minX && a.minY <= b.maxY && a.maxY >= b.minY;
+}
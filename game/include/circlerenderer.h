@@ -0,0 +1,43 @@
+#pragma once
+
+#include "raylib.h"
+#include <vector>
+
+// Draws every circle of a frame with one instanced call. Each circle is a 16 byte record
+// (position, radius, color) streamed into a dynamic vertex buffer, and a single quad is expanded
+// per instance in the vertex shader and cut down to a disc in the fragment shader, so the CPU cost
+// per circle is a copy instead of a tessellated triangle fan through the immediate batch.
+class CircleRenderer
+{
+public:
+    // Needs the GL context, so call after InitWindow. Returns false when instancing is not
+    // available, in which case circles have to be drawn the immediate way.
+    bool load();
+    void unload();
+    bool isLoaded() const;
+
+    void clear();
+    void add(Vector2 position, float radius, Color color);
+    int count() const;
+    // Flushes raylib's batch first so the circles stay in order with what was drawn before
+    void draw();
+
+private:
+    struct Instance
+    {
+        float x;
+        float y;
+        float radius;
+        unsigned char r, g, b, a;
+    };
+
+    std::vector<Instance> instances;
+    unsigned int shader = 0;
+    int mvpLocation = -1;
+    unsigned int vertexArray = 0;
+    unsigned int quadBuffer = 0;
+    unsigned int instanceBuffer = 0;
+    int instanceCapacity = 0;
+
+    void createInstanceBuffer(int capacity);
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "raylib.h"
+#include <vector>
+
+struct BodyStore;
+struct Contact;
+struct HalfspacePlane;
+class DebugDraw;
+class JobSystem;
+
+// Sequential-impulse contact solver. Every contact becomes a velocity constraint and the whole set
+// is swept a fixed number of times, each contact correcting the relative velocity of its two
+// bodies. What a contact has pushed so far is accumulated and it is the total that is clamped to
+// be non-negative, not each correction, so a contact can take back an earlier push when the bodies
+// around it settle. Penetration is removed through a velocity bias instead of moving bodies.
+//
+// The accumulated impulses are cached between steps under a key built from the body slots (and
+// the plane index), and every step starts from the impulses of the previous one. The slot
+// generations are kept next to the key, so a body spawned into a freed slot starts from nothing
+// instead of the impulses of the body before it. A resting pile
+// then begins each step already holding itself up, and the iterations only correct what changed.
+//
+// Two contacts that share a body cannot be solved at the same time, so the constraints are
+// colored greedily: each takes the first color that neither of its bodies has yet. Every color is
+// a batch with no body in common that is split across the job system without locks. Constraints
+// of bodies touching more than maxColors others go to an overflow batch solved serially after the
+// colors. Halfspaces and static circles never move, so they do not take part in the coloring.
+// Batches run in the same order whatever the thread count, so results do not depend on it.
+class ContactSolver
+{
+public:
+    int iterations = 8;
+    bool warmStarting = true;
+    // At most 32
+    int maxColors = 16;
+    // Fraction of the penetration beyond the slop that is removed per step
+    float baumgarte = 0.2f;
+    float penetrationSlop = 0.5f;
+    // Slower impacts do not bounce, so bodies resting under gravity stay put
+    float restitutionThreshold = 30.0f;
+
+    // Sizes the buffers for this many bodies and contacts, so that staying within them never
+    // allocates
+    void reserve(int bodyCount, int contactCount);
+    // Builds this step's constraints and applies the cached impulses. The contacts must come in
+    // key order: circle pairs by slot of a then b, plane contacts by plane then slot.
+    void prepare(BodyStore& bodies, const std::vector<Contact>& contacts, const std::vector<Contact>& planeContacts, const std::vector<HalfspacePlane>& planes, float friction, float dt);
+    void solve(BodyStore& bodies, JobSystem& jobs);
+    // Caches the impulses for the next step and records the plane forces to the overlay
+    void finish(const BodyStore& bodies, float dt, DebugDraw& debugDraw);
+
+    int getConstraintCount() const;
+    // Constraints of the last step that found an impulse from the step before
+    int getWarmStartedCount() const;
+    int getColorCount() const;
+    // Constraints per color of the last step, not counting the overflow batch
+    const std::vector<int>& getBatchSizes() const;
+    int getOverflowCount() const;
+
+private:
+    // a is -1 for a halfspace or static circle, which does not move, and b always moves. The normal
+    // points from a to b.
+    struct Constraint
+    {
+        int a;
+        int b;
+        Vector2 normal;
+        float normalMass;
+        float friction;
+        float bias;
+        float normalImpulse;
+        float tangentImpulse;
+    };
+
+    struct CachedImpulse
+    {
+        unsigned long long key;
+        unsigned long long generations;
+        float normalImpulse;
+        float tangentImpulse;
+    };
+
+    // Constraints in key order, and the same constraints grouped by color for solving
+    std::vector<Constraint> constraints;
+    std::vector<unsigned long long> keys;
+    // Slot generations of the bodies behind each key, a first then b, 0 for a plane
+    std::vector<unsigned long long> generations;
+    std::vector<Constraint> batched;
+    std::vector<int> batchedFrom;
+    std::vector<int> batchStart;
+    std::vector<int> batchCursor;
+    std::vector<int> batchSizes;
+    std::vector<unsigned int> bodyColors;
+    std::vector<unsigned char> constraintColors;
+    std::vector<CachedImpulse> cache;
+    int warmStarted = 0;
+    int colorCount = 0;
+
+    void addConstraint(const BodyStore& bodies, unsigned long long key, unsigned long long keyGenerations, int a, int b, Vector2 normal, float depth, float restitution, float friction, float dt);
+    void warmStart(BodyStore& bodies, const Constraint& constraint);
+    void color(const BodyStore& bodies);
+    void solveConstraint(BodyStore& bodies, Constraint& constraint);
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "raylib.h"
+#include <vector>
+
+enum DebugDrawCategory
+{
+    DEBUG_DRAW_GRAVITY,
+    DEBUG_DRAW_NET_FORCE,
+    DEBUG_DRAW_NORMAL,
+    DEBUG_DRAW_FRICTION,
+    DEBUG_DRAW_CATEGORY_COUNT
+};
+
+// Debug overlay recorded by the physics step and replayed by the renderer inside BeginDrawing.
+// Recording a disabled category returns before doing any work, so with every overlay off the step
+// does no drawing at all. Commands keep their category so turning one off hides it right away.
+class DebugDraw
+{
+public:
+    struct Line
+    {
+        Vector2 from;
+        Vector2 to;
+        float thickness;
+        Color color;
+        unsigned char category;
+        bool arrow;
+    };
+
+    struct Text
+    {
+        char text[32];
+        Vector2 position;
+        int fontSize;
+        Color color;
+        unsigned char category;
+    };
+
+    bool enabled[DEBUG_DRAW_CATEGORY_COUNT] = {};
+    std::vector<Line> lines;
+    std::vector<Text> texts;
+
+    bool isEnabled(DebugDrawCategory category) const
+    {
+        return enabled[category];
+    }
+
+    void clear();
+
+    // Inline so a disabled category costs a single test in the calling loop
+    void line(DebugDrawCategory category, Vector2 from, Vector2 to, float thickness, Color color)
+    {
+        if (!enabled[category]) return;
+        lines.push_back({ from, to, thickness, color, (unsigned char)category, false });
+    }
+
+    void arrow(DebugDrawCategory category, Vector2 from, Vector2 to, float thickness, Color color)
+    {
+        if (!enabled[category]) return;
+        lines.push_back({ from, to, thickness, color, (unsigned char)category, true });
+    }
+
+    // printf style, truncated to the fixed text buffer
+    void text(DebugDrawCategory category, Vector2 position, int fontSize, Color color, const char* format, ...);
+};
+
+const char* DebugDrawCategoryName(DebugDrawCategory category);
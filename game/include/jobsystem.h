@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing scheduler for data-parallel loops. Every worker owns a deque of index ranges: it
+// splits the range it is running in half, pushes one half to the back of its own deque and keeps
+// going on the other, until the range is no larger than the grain. Idle workers steal from the
+// front of other deques, where the biggest unsplit ranges are, so load balances itself without a
+// central queue. The calling thread is worker 0 and works alongside the others until the loop is
+// done. Workers sleep while no loop is running.
+//
+// With one thread every loop runs inline on the caller, in index order.
+class JobSystem
+{
+public:
+    JobSystem() = default;
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Counts the calling thread, so 1 means no worker threads. Must not be called from inside a
+    // loop.
+    void setThreadCount(int count);
+    int getThreadCount() const;
+    // Index of the calling worker, 0 on the thread that runs the loops. Lets a loop body write to
+    // per-worker buffers without locking.
+    static int currentWorker();
+
+    // Calls body(begin, end) over disjoint ranges covering [0, count), each at most grain long,
+    // and returns once all of them have run. Not reentrant: body must not start another loop.
+    template <typename Body>
+    void parallelFor(int count, int grain, Body body);
+
+private:
+    struct Loop
+    {
+        void (*invoke)(void* body, int begin, int end);
+        void* body;
+        int grain;
+        std::atomic<int> remaining;
+    };
+
+    struct Range
+    {
+        Loop* loop;
+        int begin;
+        int end;
+    };
+
+    // Every range pushed is half of the one split before it, so a worker never holds more than
+    // log2(count / grain) + 1 ranges, at most 32 for an int count
+    static constexpr int RANGE_CAPACITY = 64;
+
+    // Fixed ring of ranges, the owner works at the back and thieves take from the front
+    struct Worker
+    {
+        std::mutex mutex;
+        Range ranges[RANGE_CAPACITY];
+        unsigned int front = 0;
+        unsigned int back = 0;
+
+        bool empty() const { return front == back; }
+        void pushBack(const Range& range) { ranges[back++ % RANGE_CAPACITY] = range; }
+        Range popBack() { return ranges[--back % RANGE_CAPACITY]; }
+        Range popFront() { return ranges[front++ % RANGE_CAPACITY]; }
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    int activeLoops = 0;
+    std::atomic<int> activeLoopsHint{ 0 };
+    // Workers that have set up their thread and are ready for loops
+    std::atomic<int> startedThreads{ 0 };
+    bool stopping = false;
+
+    void run(Loop& loop, int count);
+    void workerMain(int index);
+    bool findRange(int index, Range& range);
+    void execute(int index, Range range);
+    void stopThreads();
+};
+
+template <typename Body>
+void JobSystem::parallelFor(int count, int grain, Body body)
+{
+    if (count <= 0) return;
+    if (grain < 1) grain = 1;
+
+    if (threads.empty() || count <= grain)
+    {
+        body(0, count);
+        return;
+    }
+
+    Loop loop;
+    loop.invoke = [](void* context, int begin, int end) { (*(Body*)context)(begin, end); };
+    loop.body = &body;
+    loop.grain = grain;
+    loop.remaining.store(count);
+    run(loop, count);
+}
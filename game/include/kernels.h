@@ -0,0 +1,47 @@
+#pragma once
+
+#include "raylib.h"
+#include "broadphase.h"
+
+// Per-body kernels of the integration stages, in a scalar version and SIMD versions picked at run
+// time. Positions, velocities and forces are interleaved
+// Vector2 arrays, so an SSE2 register holds two bodies and an AVX2 register four. Bodies whose
+// flags share a bit with skip are left as they are; the SIMD versions do that with a lane mask
+// instead of a branch.
+//
+// Every version does the same float operations in the same order as the scalar one, so the
+// results are bit for bit the same whichever is used.
+
+enum KernelLevel
+{
+    KERNEL_SCALAR,
+    KERNEL_SSE2,
+    KERNEL_AVX2,
+    KERNEL_LEVEL_COUNT
+};
+
+struct BodyKernels
+{
+    // force += gravity * mass
+    void (*addGravity)(Vector2* force, const float* mass, const unsigned char* flags, unsigned char skip, int count, Vector2 gravity);
+    // velocity += force * (invMass * dt)
+    void (*applyForces)(Vector2* velocity, const Vector2* force, const float* invMass, const unsigned char* flags, unsigned char skip, int count, float dt);
+    // position += velocity * dt
+    void (*integratePositions)(Vector2* position, const Vector2* velocity, const unsigned char* flags, unsigned char skip, int count, float dt);
+};
+
+// Best level this CPU (and OS) supports
+KernelLevel DetectKernelLevel();
+bool IsKernelLevelSupported(KernelLevel level);
+const char* KernelLevelName(KernelLevel level);
+// Falls back to the best supported level below the one asked for
+const BodyKernels& GetBodyKernels(KernelLevel level);
+
+// Pair filter of the narrow-phase. Writes the indices of the pairs whose circles touch to
+// overlapping, in order, and returns how many there are. Uses the same squared distance test as
+// CircleCircleContact, without a square root. overlapping needs room for count indices.
+//
+// Scalar only. Each pair is six loads from two random bodies and a few flops, so the loads set the
+// pace. SSE2 and AVX2 versions, with gathers or with the loads inserted lane by lane, did the same
+// loads and were no faster.
+int OverlappingPairs(const CandidatePair* pairs, int count, const Vector2* position, const float* radius, int* overlapping);
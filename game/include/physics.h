@@ -0,0 +1,461 @@
+#pragma once
+
+#include "raylib.h"
+#include "raymath.h"
+#include "broadphase.h"
+#include "spatialhash.h"
+#include "sweepandprune.h"
+#include "aabbtree.h"
+#include "debugdraw.h"
+#include "jobsystem.h"
+#include "contactsolver.h"
+#include "kernels.h"
+#include <string>
+#include <vector>
+
+// The physics core. Only the raylib types and the header-only raymath are used here, so this
+// builds without a window or GL context (see the headless target). Debug vectors go through the
+// world's DebugDraw recorder and are drawn by the GUI.
+
+enum PhysicsShape
+{
+    CIRCLE,
+    HALFSPACE
+};
+
+enum BroadPhase
+{
+    BRUTE_FORCE,
+    SPATIAL_HASH,
+    SWEEP_AND_PRUNE,
+    AABB_TREE
+};
+
+class PhysicsObject
+{
+public:
+    bool isStatic = false;
+    Vector2 position = {0 , 0 };
+    Vector2 velocity = { 0, 0 };
+    float mass = 1;
+    Vector2 netForce = { 0,0 };
+    float bounciness = 0.8f;
+
+    std::string name = "object";
+    Color color = GREEN;
+    virtual ~PhysicsObject() = default;
+    virtual PhysicsShape Shape() = 0;
+};
+
+class PhysicsHalfspace : public PhysicsObject
+{
+private:
+    float rotation = 0;
+    Vector2 normal = { 0,-1 };
+public:
+    void setRotationDegrees(float rotationInDegrees)
+    {
+        rotation = rotationInDegrees;
+        normal = Vector2Rotate({ 0,-1 },rotation * DEG2RAD);
+    }
+    float getRotation()
+    {
+        return rotation;
+    }
+    Vector2 getNormal()
+    {
+        return normal;
+    }
+
+    PhysicsShape Shape() override
+    {
+        return HALFSPACE;
+    }
+};
+
+enum BodyFlags : unsigned char
+{
+    BODY_STATIC = 1 << 0,
+    // Skipped by every stage until an awake body touches its island
+    BODY_SLEEPING = 1 << 1,
+    // Swept against the planes and circles every step, however slowly it moves
+    BODY_BULLET = 1 << 2
+};
+
+// Refers to a body for as long as it exists. The slot stays put while the body moves around in the
+// dense arrays, and the generation changes when the slot is freed so stale handles are detected.
+struct BodyHandle
+{
+    int slot = -1;
+    unsigned int generation = 0;
+};
+
+template <typename T>
+void SwapRemove(std::vector<T>& values, int index)
+{
+    values[index] = values.back();
+    values.pop_back();
+}
+
+// Structure-of-arrays storage for the circles. Every stage walks these arrays directly, so each
+// pass only pulls in the fields it actually uses. Colors and serial numbers are only read by the
+// GUI and are kept at the end.
+//
+// The arrays double as the body pool: removal swaps the last body into the hole so they stay
+// packed, and freed slots are reused through a free list. Once reserve() has been called with the
+// peak body count, spawning and despawning never allocate.
+struct BodyStore
+{
+    std::vector<Vector2> position;
+    std::vector<Vector2> velocity;
+    std::vector<Vector2> force;
+    std::vector<float> mass;
+    std::vector<float> invMass;
+    std::vector<float> radius;
+    std::vector<float> bounciness;
+    std::vector<unsigned char> flags;
+    // Seconds spent below the sleep speed, and the island a sleeping body went to sleep with
+    std::vector<float> sleepTime;
+    std::vector<int> island;
+
+    std::vector<Color> color;
+    std::vector<unsigned int> serial;
+
+    // Dense index to slot, and per slot the dense index (or next free slot) and generation
+    std::vector<int> slotOf;
+    std::vector<int> slotIndex;
+    std::vector<unsigned int> slotGeneration;
+    int firstFreeSlot = -1;
+
+    int size() const
+    {
+        return (int)position.size();
+    }
+
+    int slotCount() const
+    {
+        return (int)slotIndex.size();
+    }
+
+    void reserve(int capacity)
+    {
+        position.reserve(capacity);
+        velocity.reserve(capacity);
+        force.reserve(capacity);
+        mass.reserve(capacity);
+        invMass.reserve(capacity);
+        radius.reserve(capacity);
+        bounciness.reserve(capacity);
+        flags.reserve(capacity);
+        sleepTime.reserve(capacity);
+        island.reserve(capacity);
+        color.reserve(capacity);
+        serial.reserve(capacity);
+        slotOf.reserve(capacity);
+        slotIndex.reserve(capacity);
+        slotGeneration.reserve(capacity);
+    }
+
+    BodyHandle add(Vector2 newPosition, Vector2 newVelocity, float newRadius, float newMass, float newBounciness, unsigned int newSerial)
+    {
+        int slot = firstFreeSlot;
+        if (slot != -1)
+        {
+            firstFreeSlot = slotIndex[slot];
+        }
+        else
+        {
+            slot = slotCount();
+            slotIndex.push_back(-1);
+            slotGeneration.push_back(0);
+        }
+        slotIndex[slot] = size();
+        slotOf.push_back(slot);
+
+        position.push_back(newPosition);
+        velocity.push_back(newVelocity);
+        force.push_back({ 0,0 });
+        mass.push_back(newMass);
+        invMass.push_back(newMass > 0 ? 1.0f / newMass : 0.0f);
+        radius.push_back(newRadius);
+        bounciness.push_back(newBounciness);
+        flags.push_back(newMass > 0 ? 0 : BODY_STATIC);
+        sleepTime.push_back(0);
+        island.push_back(-1);
+        color.push_back(GREEN);
+        serial.push_back(newSerial);
+
+        return { slot, slotGeneration[slot] };
+    }
+
+    // Dense index of a live body, or -1 when the handle is stale
+    int indexOf(BodyHandle handle) const
+    {
+        if (handle.slot < 0 || handle.slot >= slotCount()) return -1;
+        if (slotGeneration[handle.slot] != handle.generation) return -1;
+        return slotIndex[handle.slot];
+    }
+
+    BodyHandle handleAt(int index) const
+    {
+        int slot = slotOf[index];
+        return { slot, slotGeneration[slot] };
+    }
+
+    void removeAt(int index)
+    {
+        int slot = slotOf[index];
+        int lastSlot = slotOf.back();
+
+        SwapRemove(position, index);
+        SwapRemove(velocity, index);
+        SwapRemove(force, index);
+        SwapRemove(mass, index);
+        SwapRemove(invMass, index);
+        SwapRemove(radius, index);
+        SwapRemove(bounciness, index);
+        SwapRemove(flags, index);
+        SwapRemove(sleepTime, index);
+        SwapRemove(island, index);
+        SwapRemove(color, index);
+        SwapRemove(serial, index);
+        SwapRemove(slotOf, index);
+
+        slotIndex[lastSlot] = index;
+        slotGeneration[slot]++;
+        slotIndex[slot] = firstFreeSlot;
+        firstFreeSlot = slot;
+    }
+};
+
+// Thin view of one circle in a BodyStore, for the GUI
+class PhysicsCircle
+{
+public:
+    BodyStore* bodies = nullptr;
+    BodyHandle handle;
+
+    bool isValid() const
+    {
+        return bodies != nullptr && bodies->indexOf(handle) != -1;
+    }
+
+    Vector2 getPosition() const { return bodies->position[bodies->indexOf(handle)]; }
+    Vector2 getVelocity() const { return bodies->velocity[bodies->indexOf(handle)]; }
+    float getRadius() const { return bodies->radius[bodies->indexOf(handle)]; }
+    unsigned int getSerial() const { return bodies->serial[bodies->indexOf(handle)]; }
+};
+
+// Snapshot of a halfspace taken at the start of each collision pass, packed so the plane test
+// streams over plain data instead of calling into the GUI-facing objects
+struct HalfspacePlane
+{
+    Vector2 point;
+    Vector2 normal;
+    float bounciness;
+};
+
+// Output of the narrow-phase. Contacts are generated from the positions at the start of the pass
+// without touching the bodies, then handed to the solver. For a halfspace contact b is the plane
+// index and the normal is the plane's.
+struct Contact
+{
+    int a;
+    int b;
+    Vector2 normal;
+    float depth;
+};
+
+// Where a swept body ends the step, stopped just inside the first thing in its way
+struct SweptImpact
+{
+    int body;
+    Vector2 position;
+};
+
+// Wall-clock seconds spent in each stage of update(), summed until resetTimings(). The forces,
+// broad-phase and sleeping run once per step, the other stages once per substep.
+struct StageTimings
+{
+    double resetNetForce = 0;
+    double gravity = 0;
+    double halfspaces = 0;
+    double broadPhase = 0;
+    double narrowPhase = 0;
+    double solver = 0;
+    double continuous = 0;
+    double kinematics = 0;
+    double sleeping = 0;
+    int steps = 0;
+    int substeps = 0;
+};
+
+// What the last step did, summed over its substeps. Contacts per candidate pair is how much of the
+// broad-phase's output was real, the number to tune the cell size and compare broad-phases by.
+struct StepStats
+{
+    // Pairs handed to the narrow-phase, every pair for brute force
+    int candidatePairs = 0;
+    // Pairs that got the exact circle test, after the awake and batched overlap filters
+    int narrowTests = 0;
+    int contacts = 0;
+    int halfspaceContacts = 0;
+    // Solver passes over a non-empty constraint set
+    int solverIterations = 0;
+    // Awake bodies moved by ApplyKinematics
+    int bodiesIntegrated = 0;
+    // Heap allocations made on any thread during the step
+    long long allocations = 0;
+
+    float efficiency() const
+    {
+        return candidatePairs > 0 ? (float)contacts / candidatePairs : 0.0f;
+    }
+};
+
+bool CircleCircleOverlap(const BodyStore& bodies, int a, int b);
+// Fills contact and returns true when the circles touch, the normal points from a to b
+bool CircleCircleContact(const BodyStore& bodies, int a, int b, Contact& contact);
+bool CircleHalfspaceOverlap(const BodyStore& bodies, int circle, PhysicsHalfspace* halfspace, DebugDraw& debugDraw);
+
+class PhysicsWorld
+{
+private:
+    unsigned int objectCount = 0;
+public:
+    // Circles go through the broad-phase. Halfspaces are infinite and kept apart.
+    BodyStore bodies;
+    std::vector<PhysicsHalfspace*> halfspaces;
+    Vector2 accelerationGravity = { 0,9 };
+    float coefficientOfFriction = 0.5f;
+    float dt = 1.0f / 50;
+    // Each step is split into this many substeps of dt / substeps. The broad-phase runs once per
+    // step with every body's bounds grown to cover its motion over the step, and the pairs it found
+    // are reused by every substep. Contacts, the solver and integration run on each substep.
+    int substeps = 1;
+    float substepDt = 1.0f / 50;
+    // Distance the bounds are grown by on top of the motion when there are substeps, for the pushes
+    // the solver gives resting bodies
+    float substepMargin = 1.0f;
+
+    BroadPhase broadPhase = SPATIAL_HASH;
+    SpatialHash spatialHash;
+    // Set when a body fell asleep, woke up, a static one was added or any was removed, so the grid's
+    // resting layer is rebuilt
+    bool restingChanged = true;
+    SweepAndPrune sweepAndPrune;
+    bool sweepAndPruneInSync = false;
+    AabbTree aabbTree;
+    std::vector<int> treeProxies;
+    bool aabbTreeInSync = false;
+    // Tree proxies of the awake bodies, the only ones the tree is queried with
+    std::vector<int> treeQueries;
+    std::vector<CandidatePair> candidatePairs;
+    int pairsTested = 0;
+    int pairsBegun = 0;
+    int pairsEnded = 0;
+    std::vector<HalfspacePlane> planes;
+    std::vector<float> planeSeparations;
+    // Contacts of the last step, sorted by body slot (and plane) so they are solved in the same
+    // order whatever the thread count or broad-phase
+    std::vector<Contact> contacts;
+    std::vector<Contact> planeContacts;
+    std::vector<std::vector<Contact>> contactBuffers;
+    std::vector<std::vector<int>> overlapBuffers;
+    std::vector<Contact> contactScratch;
+    std::vector<int> contactOffsets;
+    ContactSolver solver;
+
+    // Bodies slower than sleepSpeed for timeToSleep seconds, together with everything they touch,
+    // are put to sleep
+    bool sleepingEnabled = true;
+    float sleepSpeed = 2.0f;
+    float timeToSleep = 0.5f;
+    int awakeCount = 0;
+    int sleepingCount = 0;
+    std::vector<int> islandParent;
+    std::vector<float> islandSleepTime;
+    std::vector<int> islandIds;
+    int nextIslandId = 0;
+    Vector2 lastGravity = { 0,0 };
+    std::vector<HalfspacePlane> lastPlanes;
+
+    // Bullets, and bodies moving further than their radius in a step, are swept along their motion
+    // and stopped at the first plane or circle in the way instead of passing through it. The rest
+    // of the world keeps plain discrete steps.
+    bool continuousCollision = true;
+    // How far into the contact a swept body is stopped. Inside the solver's slop, so the contact it
+    // makes on the next step bounces it without a positional push.
+    float sweptContactDepth = 0.25f;
+    // Fraction of its motion the bounds of a swept body (or any body, with substeps) are grown by,
+    // so the solver can change its velocity a little without it reaching past them
+    float sweptMargin = 0.1f;
+    int sweptCount = 0;
+    int impactCount = 0;
+    // Circle each body goes into the broad-phase with, around the whole step's path for swept bodies
+    std::vector<Vector2> sweptCenters;
+    std::vector<float> sweptRadii;
+    std::vector<int> sweptBodies;
+    std::vector<float> impactTimes;
+    std::vector<SweptImpact> impacts;
+
+    StageTimings timings;
+    StepStats stepStats;
+    DebugDraw debugDraw;
+    // Runs the per-body stages, single threaded until setThreadCount() is called on it
+    JobSystem jobs;
+    // Instruction set of the per-body kernels, the best one available unless lowered
+    KernelLevel kernelLevel = DetectKernelLevel();
+
+    void add(PhysicsHalfspace* newHalfspace);
+    PhysicsCircle addCircle(Vector2 position, Vector2 velocity, float radius, float mass, float bounciness);
+    // Returns false for a stale handle
+    bool removeCircle(BodyHandle handle);
+    void removeCirclesOutside(Rectangle area);
+    void reserve(int capacity);
+    // Returns false for a stale handle
+    bool setBullet(BodyHandle handle, bool bullet);
+
+    // Finds the circle under a point, through the tree when it is up to date
+    PhysicsCircle pickCircle(Vector2 point);
+
+    // Advances the simulation by one step of dt
+    void update();
+    void resetTimings();
+
+    void ResetNetForce();
+    void AddGravityForce();
+    // Velocities take the forces before the contacts are solved and positions move after, so
+    // the solver sees and cancels this step's gravity
+    void ApplyForces();
+    void ApplyKinematics();
+    // Without a broad-phase pass when reusePairs is set, for the substeps after the first
+    void checkCollisions(bool reusePairs = false);
+    // Builds this step's islands and puts the ones that have been resting long enough to sleep
+    void updateSleeping();
+    void wakeIsland(int island);
+    void wakeAll();
+
+private:
+    void collideAllPairs();
+    void findPairsSpatialHash();
+    void findPairsSweepAndPrune();
+    void findPairsAabbTree();
+    Aabb circleBounds(int index) const;
+    Aabb sweptBounds(int index) const;
+    void refitTree();
+    void collideCandidatePairs();
+    void collideHalfspaces();
+    void findSweptBodies();
+    bool isSwept(int index) const;
+    // Finds where the swept bodies first hit something, ApplyKinematics then stops them there
+    void sweepFastBodies();
+    void sweepPair(int a, int b);
+    float circleImpactTime(int a, int b) const;
+    void prepareContactBuffers();
+    void gatherContacts(std::vector<Contact>& gathered);
+    void sortContacts(std::vector<Contact>& sorted, bool byPlane);
+    void solveContacts();
+    void wakeTouchedIslands();
+    int findIsland(int body);
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "physics.h"
+#include "spscqueue.h"
+#include "triplebuffer.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Everything the GUI can change about the world. The GUI edits its own copy and sends the whole of
+// it over when something changed, the physics thread applies the differences between steps.
+struct PhysicsSettings
+{
+    Vector2 gravity = { 0,9 };
+    float friction = 0.5f;
+    // Of the world's first halfspace
+    Vector2 halfspacePosition = { 0,0 };
+    float halfspaceRotation = 0;
+    BroadPhase broadPhase = SPATIAL_HASH;
+    float cellSize = 64;
+    float physicsRate = 50;
+    int substeps = 1;
+    int threads = 1;
+    int solverIterations = 8;
+    bool warmStarting = true;
+    bool sleeping = true;
+    bool continuousCollision = true;
+    bool debugDraw[DEBUG_DRAW_CATEGORY_COUNT] = {};
+    // Circles that leave it are removed, unless it is empty
+    Rectangle keepArea = { 0,0,0,0 };
+};
+
+bool operator==(const PhysicsSettings& a, const PhysicsSettings& b);
+bool operator!=(const PhysicsSettings& a, const PhysicsSettings& b);
+// The settings the world runs with now
+PhysicsSettings CaptureSettings(const PhysicsWorld& world);
+
+enum PhysicsCommandType
+{
+    COMMAND_SPAWN_CIRCLE,
+    COMMAND_SETTINGS
+};
+
+// Plain data, so it is copied through the queue as is
+struct PhysicsCommand
+{
+    PhysicsCommandType type = COMMAND_SETTINGS;
+    // COMMAND_SPAWN_CIRCLE
+    Vector2 position = { 0,0 };
+    Vector2 velocity = { 0,0 };
+    float radius = 0;
+    float mass = 0;
+    float bounciness = 0;
+    bool bullet = false;
+    // COMMAND_SETTINGS
+    PhysicsSettings settings;
+};
+
+// What the renderer needs from one step: the bodies to draw, the overlay and the numbers on the HUD
+struct RenderSnapshot
+{
+    struct Halfspace
+    {
+        Vector2 position;
+        Vector2 normal;
+        Color color;
+    };
+
+    std::vector<Vector2> position;
+    // Where each body was before the step, to draw it between the two
+    std::vector<Vector2> previousPosition;
+    std::vector<Vector2> velocity;
+    std::vector<float> radius;
+    std::vector<Color> color;
+    std::vector<unsigned int> serial;
+    std::vector<Halfspace> halfspaces;
+    DebugDraw debugDraw;
+
+    long long step = 0;
+    double simulationTime = 0;
+    // Steady clock seconds the step was due at, and its length. The step takes the world from
+    // previousPosition to position over the dt seconds after stepTime.
+    double stepTime = 0;
+    float dt = 0;
+    float stepsPerSecond = 0;
+    // Milliseconds of the work done once per step and of each substep, averaged over a second
+    double msPerStep = 0;
+    double msPerSubstep = 0;
+
+    int pairsTested = 0;
+    int pairsBegun = 0;
+    int pairsEnded = 0;
+    int treeHeight = 0;
+    int treeNodes = 0;
+    float treeAreaRatio = 0;
+    int contacts = 0;
+    int warmStarted = 0;
+    int colors = 0;
+    int largestBatch = 0;
+    int overflow = 0;
+    int awake = 0;
+    int asleep = 0;
+    int swept = 0;
+    int impacts = 0;
+    StepStats stats;
+
+    int size() const
+    {
+        return (int)position.size();
+    }
+
+    // How far the wall clock is into this step, from 0 at previousPosition to 1 at position. Drawing
+    // at this fraction trails the simulation by up to a step but moves evenly whatever the physics
+    // and render rates.
+    float interpolationAlpha() const;
+};
+
+// Seconds on the steady clock the physics thread schedules its steps with
+double PhysicsClock();
+
+// Steps a world on a thread of its own, so the simulation and the renderer do not wait on each
+// other. After every step the thread copies what the renderer needs into a snapshot and publishes
+// it through a triple buffer; the renderer draws the latest one without locking. Changes go the
+// other way as commands through a lock-free queue and are applied between steps. Once started,
+// only the physics thread touches the world.
+class PhysicsThread
+{
+public:
+    // Steps at the physics rate against the wall clock, or back to back when false. Set before
+    // start().
+    bool realTime = true;
+    // Steps taken at most to catch up after a stall, the rest of the backlog is dropped
+    int maxCatchUpSteps = 8;
+    // The thread idles once it has taken this many steps, 0 for no limit
+    long long stepLimit = 0;
+
+    explicit PhysicsThread(PhysicsWorld& world);
+    ~PhysicsThread();
+    PhysicsThread(const PhysicsThread&) = delete;
+    PhysicsThread& operator=(const PhysicsThread&) = delete;
+
+    void start();
+    // Waits for the step in progress to finish
+    void stop();
+
+    // Render thread side. Returns false when the queue is full and the command was dropped.
+    bool send(const PhysicsCommand& command);
+    // The latest published snapshot. Stays as it is until the next call.
+    const RenderSnapshot& latestSnapshot();
+
+private:
+    PhysicsWorld& world;
+    std::thread thread;
+    std::atomic<bool> running{ false };
+    SpscQueue<PhysicsCommand, 256> commands;
+    TripleBuffer<RenderSnapshot> snapshots;
+    Rectangle keepArea = { 0,0,0,0 };
+    float physicsRate = 50;
+    double simulationTime = 0;
+    long long step = 0;
+    float stepsPerSecond = 0;
+    double msPerStep = 0;
+    double msPerSubstep = 0;
+    // Walks every node, so it is only refreshed with the timings and while the tree is in use
+    float treeAreaRatio = 0;
+    double stepTime = 0;
+    // Per body slot, where the body was before the step, with the slot's generation at the time
+    std::vector<Vector2> slotPositions;
+    std::vector<unsigned int> slotGenerations;
+
+    void run();
+    void recordPositions();
+    void apply(const PhysicsCommand& command);
+    void applySettings(const PhysicsSettings& settings);
+    void publish();
+};
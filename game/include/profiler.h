@@ -0,0 +1,107 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Scoped timers for the hot paths. PROFILE_ZONE("name") times the rest of the enclosing block and
+// records it to a ring buffer owned by the calling thread, so recording never locks or shares a
+// cache line with another thread. Once per frame (or physics step) each thread calls
+// ProfilerFlush(), which folds what it recorded since the last flush into rolling per-zone
+// statistics that any thread can read through ProfilerGetStats().
+//
+// A capture records the raw zones and counters of every thread over a number of frames and writes
+// them out as Chrome trace event JSON, for chrome://tracing or ui.perfetto.dev. Threads hand their
+// events over when they flush, and the file is written on a background thread, so capturing costs
+// the frames it measures little more than a copy.
+//
+// Zone names must be string literals, they are kept by pointer. Build with PROFILER_ENABLED=0 to
+// compile every zone out.
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+// Frames kept for the rolling mean and max and the frame time graph
+static const int PROFILER_HISTORY = 120;
+// Depth of the events PROFILE_COUNTER records
+static const int PROFILE_COUNTER_DEPTH = -1;
+
+struct ProfileEvent
+{
+    const char* name;
+    // Steady clock nanoseconds
+    long long start;
+    long long end;
+    // Zones open around this one on the same thread, or PROFILE_COUNTER_DEPTH for a counter
+    int depth;
+    // Sampled value of a counter
+    double value;
+};
+
+// Milliseconds per frame over the last PROFILER_HISTORY frames, children included
+struct ProfileZoneStats
+{
+    const char* name;
+    int depth;
+    double meanMs;
+    double maxMs;
+};
+
+struct ProfileThreadStats
+{
+    std::string name;
+    // In the order the zones first ran
+    std::vector<ProfileZoneStats> zones;
+    // Time between flushes, oldest first
+    std::vector<float> frameMs;
+    double meanFrameMs = 0;
+    double maxFrameMs = 0;
+    // Events overwritten in the ring buffer before a flush got to them
+    long long lost = 0;
+};
+
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char* name);
+    ~ProfileZone();
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+    const char* name;
+    long long start;
+    int depth;
+};
+
+#if PROFILER_ENABLED
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_COUNTER(name, value) ProfilerCounter(name, (double)(value))
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_COUNTER(name, value)
+#endif
+
+long long ProfilerNow();
+// Allocates the calling thread's ring buffer up front, which would otherwise happen in its first
+// zone. For long-lived threads whose zones run inside frames that must not allocate.
+void ProfilerInitThread();
+// Ends the calling thread's frame. The name labels the thread in the statistics.
+void ProfilerFlush(const char* threadName);
+// Copies the statistics of every thread that has flushed
+void ProfilerGetStats(std::vector<ProfileThreadStats>& stats);
+// Records a value at this point in time, for the trace
+void ProfilerCounter(const char* name, double value);
+// Hands the calling thread's events to a running capture without ending a frame, for threads that
+// have no frames of their own like the job system's workers
+void ProfilerCollect(const char* threadName);
+
+// Captures every thread until the calling thread has flushed this many more frames, then writes
+// the trace to path. Returns false when a capture is already running.
+bool ProfilerStartCapture(int frames, const std::string& path);
+bool ProfilerCapturing();
+// Traces written to disk so far
+int ProfilerTracesWritten();
+// Waits for the trace being written, if any
+void ProfilerFinishWrites();
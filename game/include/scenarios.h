@@ -0,0 +1,40 @@
+#pragma once
+
+#include "physics.h"
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// A reproducible setup for benchmarking the physics core without a window. Every scenario draws
+// from its own seeded generator, so the same name, body count and seed always give the same run.
+class Scenario
+{
+public:
+    PhysicsWorld world;
+    int bodyCount = 1000;
+    unsigned int seed = 1;
+
+    virtual ~Scenario() = default;
+    virtual const char* getName() const = 0;
+    virtual void setup() = 0;
+    // Advances one step. Scenarios that keep spawning bodies do it here.
+    virtual void step();
+    // Bodies that got somewhere the scenario walls off, for scenarios that have such a place
+    virtual int countTunneled() const { return 0; }
+
+protected:
+    // The world only keeps pointers to its halfspaces, the scenario owns them
+    PhysicsHalfspace* addHalfspace(Vector2 position, float rotationDegrees, float bounciness);
+    float random(float min, float max);
+
+private:
+    std::vector<std::unique_ptr<PhysicsHalfspace>> ownedHalfspaces;
+    std::mt19937 generator;
+    bool seeded = false;
+};
+
+// Returns nullptr for an unknown name
+std::unique_ptr<Scenario> CreateScenario(const std::string& name);
+// Names accepted by CreateScenario, for usage messages
+const std::vector<std::string>& ScenarioNames();
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "raylib.h"
+#include "broadphase.h"
+#include <vector>
+
+// Uniform grid broad-phase. Every body is binned into each cell its bounding box touches and only
+// bodies sharing a cell become candidate pairs. Moving bodies are rebinned from scratch every step,
+// so the cost is linear in the number of them as long as the cell size is close to the body size.
+//
+// Bodies that do not move go into a resting layer instead, which is kept between steps and only
+// rebuilt when its bodies change. Resting bodies are only paired with moving ones, so a sleeping
+// pile costs nothing until something lands on it.
+class SpatialHash
+{
+public:
+    float cellSize = 64;
+
+    // Sizes the buffers of both layers for this many bodies, each touching up to four cells
+    void reserve(int count);
+    void clear();
+    void insert(int id, Vector2 center, float radius);
+    void clearResting();
+    void insertResting(int id, Vector2 center, float radius);
+    // Pairs of two moving bodies, and of a moving and a resting body
+    void findPairs(std::vector<CandidatePair>& pairs);
+
+private:
+    struct Proxy
+    {
+        int id;
+        Aabb bounds;
+    };
+
+    struct Entry
+    {
+        unsigned long long cell;
+        int proxy;
+    };
+
+    // Bodies binned into the grid, with the entries sorted by bucket so every cell's occupants end
+    // up next to each other
+    struct Layer
+    {
+        std::vector<Proxy> proxies;
+        std::vector<Entry> entries;
+        std::vector<Entry> sortedEntries;
+        std::vector<int> bucketStart;
+        unsigned int bucketMask = 0;
+
+        void reserve(int count);
+    };
+
+    Layer moving;
+    Layer resting;
+    // Cell size the resting layer was binned with, 0 when it has to be binned again
+    float restingCellSize = 0;
+    std::vector<int> bucketCursor;
+
+    void bin(Layer& layer, int proxyIndex);
+    void sort(Layer& layer);
+    void addPair(const Proxy& proxyA, const Proxy& proxyB, unsigned long long cell, std::vector<CandidatePair>& pairs) const;
+    int cellCoordinate(float value) const;
+    unsigned long long cellKey(int cellX, int cellY) const;
+    unsigned int bucketOf(unsigned long long cell, unsigned int bucketMask) const;
+};
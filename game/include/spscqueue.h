@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+
+// Bounded queue between exactly one producer thread and one consumer thread, without locks. Each
+// side only ever writes its own index and reads the other's, so a release store of the index after
+// the slot is written is all the synchronization needed. One slot always stays empty to tell a
+// full queue from an empty one.
+template <typename T, int Capacity>
+class SpscQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // Producer side. Returns false, dropping the value, when the queue is full.
+    bool push(const T& value)
+    {
+        int head = this->head.load(std::memory_order_relaxed);
+        int next = (head + 1) & (Capacity - 1);
+        if (next == tail.load(std::memory_order_acquire)) return false;
+
+        slots[head] = value;
+        this->head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false when there is nothing to take.
+    bool pop(T& value)
+    {
+        int tail = this->tail.load(std::memory_order_relaxed);
+        if (tail == head.load(std::memory_order_acquire)) return false;
+
+        value = slots[tail];
+        this->tail.store((tail + 1) & (Capacity - 1), std::memory_order_release);
+        return true;
+    }
+
+private:
+    T slots[Capacity];
+    // On separate cache lines, so the two threads do not fight over one
+    alignas(64) std::atomic<int> head{ 0 };
+    alignas(64) std::atomic<int> tail{ 0 };
+};
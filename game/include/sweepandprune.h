@@ -0,0 +1,98 @@
+#pragma once
+
+#include "raylib.h"
+#include "broadphase.h"
+#include <vector>
+
+// Incremental sort-and-sweep broad-phase. The endpoint lists of both axes persist between steps,
+// and since bodies only move a little per step each endpoint that moved is shifted into place with
+// a few swaps. Overlapping pairs are found from those swaps, so the pair list is updated with
+// begin/end events instead of being rediscovered every step.
+//
+// Only the proxies set since the last update are re-sorted, like Box2D's move buffer, and new ones
+// are merged in as a batch. A proxy that is not set keeps its bounds, so sleeping bodies cost
+// nothing and are only passed by the ones that move.
+class SweepAndPrune
+{
+public:
+    struct PairEvent
+    {
+        int a;
+        int b;
+        bool began;
+    };
+
+    // Pairs currently overlapping, and every begin/end since the owner last cleared the events
+    std::vector<CandidatePair> pairs;
+    std::vector<PairEvent> events;
+
+    // Sizes every buffer for this many proxies and overlapping pairs, so that staying within them
+    // never allocates
+    void reserve(int proxyCount, int pairCount);
+    // Adds the proxy or moves it, either way it is sorted into place by the next update()
+    void setProxy(int id, Vector2 center, float radius);
+    void removeProxy(int id);
+    bool hasProxy(int id) const;
+    void update();
+
+private:
+    struct Proxy
+    {
+        Aabb bounds;
+        // Where the proxy's endpoints are on each axis
+        int minIndex[2];
+        int maxIndex[2];
+        bool active = false;
+        bool removed = false;
+        bool moved = false;
+        // Set but not yet given endpoints
+        bool added = false;
+        // Position in the sweep's active list while insertAdded() runs
+        int activeIndex = -1;
+    };
+
+    struct Endpoint
+    {
+        float value;
+        int id;
+        bool isMax;
+    };
+
+    // Open addressing with linear probing, from pair key to the pair's index in pairs
+    struct PairSlot
+    {
+        unsigned long long key;
+        int index;
+    };
+
+    static constexpr unsigned long long EMPTY_KEY = ~0ull;
+
+    std::vector<Proxy> proxies;
+    // x then y
+    std::vector<Endpoint> axes[2];
+    // Proxies set since the last update
+    std::vector<int> moveBuffer;
+    std::vector<Endpoint> addedEndpoints;
+    std::vector<Endpoint> mergedEndpoints;
+    // Proxies whose x interval is open during the sweep of insertAdded(), new and old apart
+    std::vector<int> activeAdded;
+    std::vector<int> activeOld;
+    // Power of two in size and kept at most half full
+    std::vector<PairSlot> pairTable;
+    int pendingRemovals = 0;
+
+    void flushRemovals();
+    void insertAdded();
+    void moveEndpoint(int axis, int index, float value);
+    void swapEndpoints(int axis, int indexA, int indexB);
+    void placeEndpoint(int axis, const Endpoint& endpoint, int index);
+    static bool sortsAfter(const Endpoint& a, const Endpoint& b);
+    bool overlapping(int idA, int idB, int axis) const;
+    void addPair(int idA, int idB);
+    void removePair(int idA, int idB);
+    static unsigned long long pairKey(int idA, int idB);
+    int findPairSlot(unsigned long long key) const;
+    void insertPairSlot(unsigned long long key, int index);
+    void erasePairSlot(int slot);
+    void rebuildPairTable(int capacity);
+};
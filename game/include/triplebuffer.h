@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+
+// Hands the latest of a stream of values from one writer thread to one reader thread, without
+// locks and without either side ever waiting. The writer fills the back buffer and publishes it by
+// swapping it with the middle one; the reader takes the middle one when it holds something newer
+// than its front buffer. Values the reader was too slow to see are skipped, and the front buffer
+// does not change under the reader until it asks for the next one.
+//
+// The buffers are reused, so a value that keeps its vectors between writes stops allocating once
+// they have grown.
+template <typename T>
+class TripleBuffer
+{
+public:
+    // Writer side: the buffer to fill next
+    T& back()
+    {
+        return buffers[backIndex];
+    }
+
+    void publish()
+    {
+        backIndex = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Reader side: moves to the latest published buffer, returns false when there is none newer
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    const T& front() const
+    {
+        return buffers[frontIndex];
+    }
+
+private:
+    static const int INDEX_MASK = 3;
+    // Set on the middle index while it holds a buffer the reader has not taken yet
+    static const int FRESH = 4;
+
+    T buffers[3];
+    int backIndex = 0;
+    std::atomic<int> middle{ 1 };
+    int frontIndex = 2;
+};
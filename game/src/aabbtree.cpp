@@ -0,0 +1,389 @@
+#include "aabbtree.h"
+#include <algorithm>
+
+static Aabb Union(const Aabb& a, const Aabb& b)
+{
+    return { std::min(a.minX, b.minX), std::min(a.minY, b.minY), std::max(a.maxX, b.maxX), std::max(a.maxY, b.maxY) };
+}
+
+static float Perimeter(const Aabb& bounds)
+{
+    return 2.0f * ((bounds.maxX - bounds.minX) + (bounds.maxY - bounds.minY));
+}
+
+static bool Contains(const Aabb& outer, const Aabb& inner)
+{
+    return outer.minX <= inner.minX && outer.minY <= inner.minY && outer.maxX >= inner.maxX && outer.maxY >= inner.maxY;
+}
+
+void AabbTree::reserve(int leafCount)
+{
+    // A tree of n leaves has n - 1 internal nodes
+    nodes.reserve(leafCount * 2);
+}
+
+int AabbTree::createProxy(int id, const Aabb& bounds)
+{
+    int proxy = allocateNode();
+    Node& node = nodes[proxy];
+    node.bounds = { bounds.minX - margin, bounds.minY - margin, bounds.maxX + margin, bounds.maxY + margin };
+    node.id = id;
+    node.height = 0;
+
+    insertLeaf(proxy);
+    leafCount++;
+    return proxy;
+}
+
+void AabbTree::destroyProxy(int proxy)
+{
+    removeLeaf(proxy);
+    freeNode(proxy);
+    leafCount--;
+}
+
+bool AabbTree::moveProxy(int proxy, const Aabb& bounds, Vector2 displacement)
+{
+    if (Contains(nodes[proxy].bounds, bounds)) return false;
+
+    removeLeaf(proxy);
+
+    // Extend the fat box in the direction of travel so a steadily moving body is not reinserted
+    // every step
+    Aabb fat = { bounds.minX - margin, bounds.minY - margin, bounds.maxX + margin, bounds.maxY + margin };
+    Vector2 predicted = { displacement.x * displacementMultiplier, displacement.y * displacementMultiplier };
+    if (predicted.x < 0) fat.minX += predicted.x; else fat.maxX += predicted.x;
+    if (predicted.y < 0) fat.minY += predicted.y; else fat.maxY += predicted.y;
+    nodes[proxy].bounds = fat;
+
+    insertLeaf(proxy);
+    return true;
+}
+
+const Aabb& AabbTree::getFatBounds(int proxy) const
+{
+    return nodes[proxy].bounds;
+}
+
+int AabbTree::getId(int proxy) const
+{
+    return nodes[proxy].id;
+}
+
+void AabbTree::findPairs(const std::vector<int>& queryProxies, std::vector<CandidatePair>& pairs)
+{
+    pairs.clear();
+
+    for (int i = 0; i < queryProxies.size(); i++)
+    {
+        nodes[queryProxies[i]].queried = true;
+    }
+
+    for (int i = 0; i < queryProxies.size(); i++)
+    {
+        int proxy = queryProxies[i];
+        int id = nodes[proxy].id;
+        queryNodes(nodes[proxy].bounds, [&](int other)
+        {
+            // Two queried leaves find each other, only the one with the lower node reports it
+            const Node& node = nodes[other];
+            if (other == proxy || (node.queried && other < proxy)) return true;
+
+            if (id < node.id)
+                pairs.push_back({ id, node.id });
+            else
+                pairs.push_back({ node.id, id });
+            return true;
+        });
+    }
+
+    for (int i = 0; i < queryProxies.size(); i++)
+    {
+        nodes[queryProxies[i]].queried = false;
+    }
+}
+
+int AabbTree::getHeight() const
+{
+    return root == NULL_NODE ? 0 : nodes[root].height;
+}
+
+int AabbTree::getNodeCount() const
+{
+    return nodeCount;
+}
+
+int AabbTree::getLeafCount() const
+{
+    return leafCount;
+}
+
+float AabbTree::getAreaRatio() const
+{
+    if (root == NULL_NODE) return 0;
+
+    float rootArea = Perimeter(nodes[root].bounds);
+    if (rootArea <= 0) return 0;
+
+    float totalArea = 0;
+    for (int i = 0; i < nodes.size(); i++)
+    {
+        if (nodes[i].height < 0) continue;
+        totalArea += Perimeter(nodes[i].bounds);
+    }
+    return totalArea / rootArea;
+}
+
+int AabbTree::allocateNode()
+{
+    if (freeList == NULL_NODE)
+    {
+        nodes.push_back({});
+        nodes.back().parent = NULL_NODE;
+        freeList = (int)nodes.size() - 1;
+    }
+
+    // Free nodes reuse parent as the next link
+    int node = freeList;
+    freeList = nodes[node].parent;
+    nodes[node].parent = NULL_NODE;
+    nodes[node].child1 = NULL_NODE;
+    nodes[node].child2 = NULL_NODE;
+    nodes[node].height = 0;
+    nodes[node].id = -1;
+    nodes[node].queried = false;
+    nodeCount++;
+    return node;
+}
+
+void AabbTree::freeNode(int node)
+{
+    nodes[node].parent = freeList;
+    nodes[node].height = -1;
+    freeList = node;
+    nodeCount--;
+}
+
+void AabbTree::insertLeaf(int leaf)
+{
+    if (root == NULL_NODE)
+    {
+        root = leaf;
+        nodes[root].parent = NULL_NODE;
+        return;
+    }
+
+    // Descend towards the sibling that adds the least perimeter, counting the growth every
+    // ancestor inherits from the insert
+    Aabb leafBounds = nodes[leaf].bounds;
+    int index = root;
+    while (!nodes[index].isLeaf())
+    {
+        const Node& node = nodes[index];
+        float area = Perimeter(node.bounds);
+        float combinedArea = Perimeter(Union(node.bounds, leafBounds));
+
+        float cost = 2.0f * combinedArea;
+        float inheritanceCost = 2.0f * (combinedArea - area);
+
+        float childCosts[2];
+        int children[2] = { node.child1, node.child2 };
+        for (int c = 0; c < 2; c++)
+        {
+            const Node& child = nodes[children[c]];
+            float grownArea = Perimeter(Union(child.bounds, leafBounds));
+            if (child.isLeaf())
+                childCosts[c] = grownArea + inheritanceCost;
+            else
+                childCosts[c] = (grownArea - Perimeter(child.bounds)) + inheritanceCost;
+        }
+
+        if (cost < childCosts[0] && cost < childCosts[1]) break;
+
+        index = childCosts[0] < childCosts[1] ? children[0] : children[1];
+    }
+
+    int sibling = index;
+    int oldParent = nodes[sibling].parent;
+    int newParent = allocateNode();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].bounds = Union(leafBounds, nodes[sibling].bounds);
+    nodes[newParent].height = nodes[sibling].height + 1;
+    nodes[newParent].child1 = sibling;
+    nodes[newParent].child2 = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+
+    if (oldParent != NULL_NODE)
+    {
+        if (nodes[oldParent].child1 == sibling)
+            nodes[oldParent].child1 = newParent;
+        else
+            nodes[oldParent].child2 = newParent;
+    }
+    else
+    {
+        root = newParent;
+    }
+
+    refit(nodes[leaf].parent);
+}
+
+void AabbTree::removeLeaf(int leaf)
+{
+    if (leaf == root)
+    {
+        root = NULL_NODE;
+        return;
+    }
+
+    int parent = nodes[leaf].parent;
+    int grandParent = nodes[parent].parent;
+    int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+    if (grandParent != NULL_NODE)
+    {
+        if (nodes[grandParent].child1 == parent)
+            nodes[grandParent].child1 = sibling;
+        else
+            nodes[grandParent].child2 = sibling;
+        nodes[sibling].parent = grandParent;
+        freeNode(parent);
+
+        refit(grandParent);
+    }
+    else
+    {
+        root = sibling;
+        nodes[sibling].parent = NULL_NODE;
+        freeNode(parent);
+    }
+}
+
+void AabbTree::refit(int node)
+{
+    // Walk to the root, rebalancing and recomputing heights and boxes
+    while (node != NULL_NODE)
+    {
+        node = balance(node);
+
+        Node& current = nodes[node];
+        const Node& child1 = nodes[current.child1];
+        const Node& child2 = nodes[current.child2];
+        current.height = 1 + std::max(child1.height, child2.height);
+        current.bounds = Union(child1.bounds, child2.bounds);
+
+        node = current.parent;
+    }
+}
+
+int AabbTree::balance(int indexA)
+{
+    Node& a = nodes[indexA];
+    if (a.isLeaf() || a.height < 2) return indexA;
+
+    int indexB = a.child1;
+    int indexC = a.child2;
+    Node& b = nodes[indexB];
+    Node& c = nodes[indexC];
+
+    int heightDifference = c.height - b.height;
+
+    // Rotate C up
+    if (heightDifference > 1)
+    {
+        int indexF = c.child1;
+        int indexG = c.child2;
+        Node& f = nodes[indexF];
+        Node& g = nodes[indexG];
+
+        c.child1 = indexA;
+        c.parent = a.parent;
+        a.parent = indexC;
+
+        if (c.parent != NULL_NODE)
+        {
+            if (nodes[c.parent].child1 == indexA)
+                nodes[c.parent].child1 = indexC;
+            else
+                nodes[c.parent].child2 = indexC;
+        }
+        else
+        {
+            root = indexC;
+        }
+
+        if (f.height > g.height)
+        {
+            c.child2 = indexF;
+            a.child2 = indexG;
+            g.parent = indexA;
+            a.bounds = Union(b.bounds, g.bounds);
+            c.bounds = Union(a.bounds, f.bounds);
+            a.height = 1 + std::max(b.height, g.height);
+            c.height = 1 + std::max(a.height, f.height);
+        }
+        else
+        {
+            c.child2 = indexG;
+            a.child2 = indexF;
+            f.parent = indexA;
+            a.bounds = Union(b.bounds, f.bounds);
+            c.bounds = Union(a.bounds, g.bounds);
+            a.height = 1 + std::max(b.height, f.height);
+            c.height = 1 + std::max(a.height, g.height);
+        }
+
+        return indexC;
+    }
+
+    // Rotate B up
+    if (heightDifference < -1)
+    {
+        int indexD = b.child1;
+        int indexE = b.child2;
+        Node& d = nodes[indexD];
+        Node& e = nodes[indexE];
+
+        b.child1 = indexA;
+        b.parent = a.parent;
+        a.parent = indexB;
+
+        if (b.parent != NULL_NODE)
+        {
+            if (nodes[b.parent].child1 == indexA)
+                nodes[b.parent].child1 = indexB;
+            else
+                nodes[b.parent].child2 = indexB;
+        }
+        else
+        {
+            root = indexB;
+        }
+
+        if (d.height > e.height)
+        {
+            b.child2 = indexD;
+            a.child1 = indexE;
+            e.parent = indexA;
+            a.bounds = Union(c.bounds, e.bounds);
+            b.bounds = Union(a.bounds, d.bounds);
+            a.height = 1 + std::max(c.height, e.height);
+            b.height = 1 + std::max(a.height, d.height);
+        }
+        else
+        {
+            b.child2 = indexE;
+            a.child1 = indexD;
+            d.parent = indexA;
+            a.bounds = Union(c.bounds, d.bounds);
+            b.bounds = Union(a.bounds, e.bounds);
+            a.height = 1 + std::max(c.height, d.height);
+            b.height = 1 + std::max(a.height, e.height);
+        }
+
+        return indexB;
+    }
+
+    return indexA;
+}
@@ -0,0 +1,139 @@
+#include "circlerenderer.h"
+#include "raymath.h"
+#include "rlgl.h"
+#include <cstddef>
+
+static const char* CircleVertexShader = R"(#version 330
+layout(location = 0) in vec2 corner;
+layout(location = 1) in vec3 instance;
+layout(location = 2) in vec4 instanceColor;
+uniform mat4 mvp;
+out vec2 fragCorner;
+out vec4 fragColor;
+void main()
+{
+    fragCorner = corner;
+    fragColor = instanceColor;
+    gl_Position = mvp * vec4(instance.xy + corner * instance.z, 0.0, 1.0);
+}
+)";
+
+static const char* CircleFragmentShader = R"(#version 330
+in vec2 fragCorner;
+in vec4 fragColor;
+out vec4 finalColor;
+void main()
+{
+    // One pixel of antialiasing at the rim, whatever the radius
+    float distance = length(fragCorner);
+    float edge = fwidth(distance);
+    float coverage = 1.0 - smoothstep(1.0 - edge, 1.0, distance);
+    if (coverage <= 0.0) discard;
+    finalColor = vec4(fragColor.rgb, fragColor.a * coverage);
+}
+)";
+
+static const int CORNER_ATTRIBUTE = 0;
+static const int INSTANCE_ATTRIBUTE = 1;
+static const int COLOR_ATTRIBUTE = 2;
+
+bool CircleRenderer::load()
+{
+    // rlgl hands back its default shader, not 0, when compiling or linking fails
+    shader = rlLoadShaderCode(CircleVertexShader, CircleFragmentShader);
+    if (shader == 0 || shader == rlGetShaderIdDefault())
+    {
+        shader = 0;
+        return false;
+    }
+    mvpLocation = rlGetLocationUniform(shader, "mvp");
+
+    vertexArray = rlLoadVertexArray();
+    if (vertexArray == 0)
+    {
+        unload();
+        return false;
+    }
+
+    // Two triangles covering the unit square, scaled by the radius per instance
+    const float corners[] = { -1, -1, 1, -1, 1, 1, -1, -1, 1, 1, -1, 1 };
+    rlEnableVertexArray(vertexArray);
+    quadBuffer = rlLoadVertexBuffer(corners, sizeof(corners), false);
+    rlSetVertexAttribute(CORNER_ATTRIBUTE, 2, RL_FLOAT, false, 0, 0);
+    rlEnableVertexAttribute(CORNER_ATTRIBUTE);
+    createInstanceBuffer(4096);
+    rlDisableVertexArray();
+    return true;
+}
+
+void CircleRenderer::unload()
+{
+    if (instanceBuffer != 0) rlUnloadVertexBuffer(instanceBuffer);
+    if (quadBuffer != 0) rlUnloadVertexBuffer(quadBuffer);
+    if (vertexArray != 0) rlUnloadVertexArray(vertexArray);
+    // Never the default shader, load() does not keep it
+    if (shader != 0 && shader != rlGetShaderIdDefault()) rlUnloadShaderProgram(shader);
+    instanceBuffer = 0;
+    quadBuffer = 0;
+    vertexArray = 0;
+    shader = 0;
+    instanceCapacity = 0;
+}
+
+bool CircleRenderer::isLoaded() const
+{
+    return shader != 0 && vertexArray != 0;
+}
+
+void CircleRenderer::clear()
+{
+    instances.clear();
+}
+
+void CircleRenderer::add(Vector2 position, float radius, Color color)
+{
+    instances.push_back({ position.x, position.y, radius, color.r, color.g, color.b, color.a });
+}
+
+int CircleRenderer::count() const
+{
+    return (int)instances.size();
+}
+
+void CircleRenderer::draw()
+{
+    if (!isLoaded() || instances.empty()) return;
+
+    rlDrawRenderBatchActive();
+
+    rlEnableVertexArray(vertexArray);
+    if (instances.size() > instanceCapacity)
+    {
+        int capacity = instanceCapacity;
+        while (capacity < instances.size()) capacity *= 2;
+        rlUnloadVertexBuffer(instanceBuffer);
+        createInstanceBuffer(capacity);
+    }
+    rlUpdateVertexBuffer(instanceBuffer, instances.data(), (int)(instances.size() * sizeof(Instance)), 0);
+
+    rlEnableShader(shader);
+    Matrix mvp = MatrixMultiply(rlGetMatrixModelview(), rlGetMatrixProjection());
+    rlSetUniformMatrix(mvpLocation, mvp);
+    rlDrawVertexArrayInstanced(0, 6, (int)instances.size());
+    rlDisableShader();
+    rlDisableVertexArray();
+}
+
+// Expects the vertex array to be bound
+void CircleRenderer::createInstanceBuffer(int capacity)
+{
+    instanceBuffer = rlLoadVertexBuffer(nullptr, capacity * (int)sizeof(Instance), true);
+    instanceCapacity = capacity;
+
+    rlSetVertexAttribute(INSTANCE_ATTRIBUTE, 3, RL_FLOAT, false, sizeof(Instance), 0);
+    rlEnableVertexAttribute(INSTANCE_ATTRIBUTE);
+    rlSetVertexAttributeDivisor(INSTANCE_ATTRIBUTE, 1);
+    rlSetVertexAttribute(COLOR_ATTRIBUTE, 4, RL_UNSIGNED_BYTE, true, sizeof(Instance), offsetof(Instance, r));
+    rlEnableVertexAttribute(COLOR_ATTRIBUTE);
+    rlSetVertexAttributeDivisor(COLOR_ATTRIBUTE, 1);
+}
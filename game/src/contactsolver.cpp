@@ -0,0 +1,285 @@
+#include "contactsolver.h"
+#include "physics.h"
+#include <algorithm>
+#include <cmath>
+
+// Plane keys sort after every circle pair key, so both lists together stay in key order
+static const unsigned long long PLANE_KEY = 1ull << 63;
+// Constraints per job range. Each one is a few dozen flops, so ranges have to be long.
+static const int SOLVE_GRAIN = 256;
+
+static void ApplyImpulse(BodyStore& bodies, int a, int b, Vector2 impulse)
+{
+    if (a != -1) bodies.velocity[a] -= impulse * bodies.invMass[a];
+    bodies.velocity[b] += impulse * bodies.invMass[b];
+}
+
+static Vector2 RelativeVelocity(const BodyStore& bodies, int a, int b)
+{
+    if (a == -1) return bodies.velocity[b];
+    return bodies.velocity[b] - bodies.velocity[a];
+}
+
+// Calls solve(index) for every batched constraint, color after color with each color split across
+// the job system, then serially for the overflow batch
+template <typename Solve>
+static void SolveBatches(JobSystem& jobs, const std::vector<int>& batchStart, int colorCount, Solve solve)
+{
+    for (int color = 0; color < colorCount; color++)
+    {
+        int first = batchStart[color];
+        jobs.parallelFor(batchStart[color + 1] - first, SOLVE_GRAIN, [&](int begin, int end)
+        {
+            for (int i = first + begin; i < first + end; i++)
+            {
+                solve(i);
+            }
+        });
+    }
+
+    int overflow = (int)batchStart.size() - 2;
+    for (int i = batchStart[overflow]; i < batchStart[overflow + 1]; i++)
+    {
+        solve(i);
+    }
+}
+
+void ContactSolver::reserve(int bodyCount, int contactCount)
+{
+    bodyColors.reserve(bodyCount);
+    constraints.reserve(contactCount);
+    keys.reserve(contactCount);
+    generations.reserve(contactCount);
+    batched.reserve(contactCount);
+    batchedFrom.reserve(contactCount);
+    constraintColors.reserve(contactCount);
+    cache.reserve(contactCount);
+    batchStart.reserve(maxColors + 2);
+    batchCursor.reserve(maxColors + 1);
+    batchSizes.reserve(maxColors);
+}
+
+void ContactSolver::prepare(BodyStore& bodies, const std::vector<Contact>& contacts, const std::vector<Contact>& planeContacts, const std::vector<HalfspacePlane>& planes, float friction, float dt)
+{
+    constraints.clear();
+    keys.clear();
+    generations.clear();
+
+    for (int i = 0; i < contacts.size(); i++)
+    {
+        const Contact& contact = contacts[i];
+        int slotA = bodies.slotOf[contact.a];
+        int slotB = bodies.slotOf[contact.b];
+        unsigned long long key = (unsigned long long)slotA << 32 | (unsigned int)slotB;
+        unsigned long long keyGenerations = (unsigned long long)bodies.slotGeneration[slotA] << 32 | bodies.slotGeneration[slotB];
+        float restitution = bodies.bounciness[contact.a] * bodies.bounciness[contact.b];
+        addConstraint(bodies, key, keyGenerations, contact.a, contact.b, contact.normal, contact.depth, restitution, friction, dt);
+    }
+
+    for (int i = 0; i < planeContacts.size(); i++)
+    {
+        const Contact& contact = planeContacts[i];
+        int slot = bodies.slotOf[contact.a];
+        unsigned long long key = PLANE_KEY | (unsigned long long)contact.b << 32 | (unsigned int)slot;
+        float restitution = bodies.bounciness[contact.a] * planes[contact.b].bounciness;
+        addConstraint(bodies, key, bodies.slotGeneration[slot], -1, contact.a, contact.normal, contact.depth, restitution, friction, dt);
+    }
+
+    // Both lists are in key order, so matching against last step's cache is a single merge pass
+    warmStarted = 0;
+    if (warmStarting)
+    {
+        int cached = 0;
+        for (int i = 0; i < constraints.size(); i++)
+        {
+            while (cached < cache.size() && cache[cached].key < keys[i]) cached++;
+            if (cached == cache.size()) break;
+            if (cache[cached].key != keys[i] || cache[cached].generations != generations[i]) continue;
+
+            constraints[i].normalImpulse = cache[cached].normalImpulse;
+            constraints[i].tangentImpulse = cache[cached].tangentImpulse;
+            warmStarted++;
+        }
+    }
+
+    color(bodies);
+}
+
+void ContactSolver::color(const BodyStore& bodies)
+{
+    int colors = std::min(std::max(maxColors, 1), 32);
+    bodyColors.assign(bodies.size(), 0);
+    constraintColors.resize(constraints.size());
+    batchStart.assign(colors + 2, 0);
+
+    // One bit per color taken by each body, the first color free on both sides wins
+    colorCount = 0;
+    for (int i = 0; i < constraints.size(); i++)
+    {
+        const Constraint& constraint = constraints[i];
+        unsigned int taken = bodyColors[constraint.b];
+        if (constraint.a != -1) taken |= bodyColors[constraint.a];
+
+        int color = 0;
+        while (color < colors && (taken >> color & 1)) color++;
+        if (color < colors)
+        {
+            bodyColors[constraint.b] |= 1u << color;
+            if (constraint.a != -1) bodyColors[constraint.a] |= 1u << color;
+            colorCount = std::max(colorCount, color + 1);
+        }
+        constraintColors[i] = (unsigned char)color;
+        batchStart[color + 1]++;
+    }
+
+    batchSizes.assign(batchStart.begin() + 1, batchStart.begin() + 1 + colorCount);
+    for (int color = 0; color <= colors; color++)
+    {
+        batchStart[color + 1] += batchStart[color];
+    }
+
+    // Stable, so every batch keeps the key order
+    batched.resize(constraints.size());
+    batchedFrom.resize(constraints.size());
+    batchCursor.assign(batchStart.begin(), batchStart.end() - 1);
+    for (int i = 0; i < constraints.size(); i++)
+    {
+        int position = batchCursor[constraintColors[i]]++;
+        batched[position] = constraints[i];
+        batchedFrom[position] = i;
+    }
+
+    // Greedy coloring leaves no gaps, the colors past the last one used are all empty
+    if (colorCount < colors)
+    {
+        batchStart.erase(batchStart.begin() + colorCount + 1, batchStart.begin() + colors + 1);
+    }
+}
+
+void ContactSolver::addConstraint(const BodyStore& bodies, unsigned long long key, unsigned long long keyGenerations, int a, int b, Vector2 normal, float depth, float restitution, float friction, float dt)
+{
+    bool staticA = a == -1 || (bodies.flags[a] & BODY_STATIC);
+    bool staticB = (bodies.flags[b] & BODY_STATIC) != 0;
+    if (staticA && staticB) return;
+
+    // Only b is written to, so the body that moves goes there. Turning the normal around with it
+    // keeps the constraint and its cached impulses the same.
+    if (staticB)
+    {
+        b = a;
+        normal = normal * -1;
+    }
+    if (staticA || staticB) a = -1;
+    float inverseMassSum = bodies.invMass[b] + (a != -1 ? bodies.invMass[a] : 0.0f);
+
+    Constraint constraint;
+    constraint.a = a;
+    constraint.b = b;
+    constraint.normal = normal;
+    constraint.normalMass = 1.0f / inverseMassSum;
+    constraint.friction = friction;
+    constraint.normalImpulse = 0;
+    constraint.tangentImpulse = 0;
+
+    // Aim for the bounce velocity on impact, otherwise for a speed that closes part of the overlap
+    float closingVelocity = Vector2DotProduct(RelativeVelocity(bodies, a, b), normal);
+    float bounce = closingVelocity < -restitutionThreshold ? -restitution * closingVelocity : 0.0f;
+    float push = baumgarte / dt * fmaxf(depth - penetrationSlop, 0.0f);
+    constraint.bias = fmaxf(bounce, push);
+
+    constraints.push_back(constraint);
+    keys.push_back(key);
+    generations.push_back(keyGenerations);
+}
+
+void ContactSolver::warmStart(BodyStore& bodies, const Constraint& constraint)
+{
+    Vector2 tangent = { -constraint.normal.y, constraint.normal.x };
+    Vector2 impulse = constraint.normal * constraint.normalImpulse + tangent * constraint.tangentImpulse;
+    ApplyImpulse(bodies, constraint.a, constraint.b, impulse);
+}
+
+void ContactSolver::solve(BodyStore& bodies, JobSystem& jobs)
+{
+    if (warmStarted > 0)
+    {
+        SolveBatches(jobs, batchStart, colorCount, [&](int i) { warmStart(bodies, batched[i]); });
+    }
+
+    for (int iteration = 0; iteration < iterations; iteration++)
+    {
+        SolveBatches(jobs, batchStart, colorCount, [&](int i) { solveConstraint(bodies, batched[i]); });
+    }
+}
+
+void ContactSolver::solveConstraint(BodyStore& bodies, Constraint& constraint)
+{
+    int a = constraint.a;
+    int b = constraint.b;
+    Vector2 normal = constraint.normal;
+    Vector2 tangent = { -normal.y, normal.x };
+
+    // Friction first, bounded by what the normal impulse is so far
+    float tangentSpeed = Vector2DotProduct(RelativeVelocity(bodies, a, b), tangent);
+    float maxFriction = constraint.friction * constraint.normalImpulse;
+    float previous = constraint.tangentImpulse;
+    constraint.tangentImpulse = Clamp(previous - tangentSpeed * constraint.normalMass, -maxFriction, maxFriction);
+    ApplyImpulse(bodies, a, b, tangent * (constraint.tangentImpulse - previous));
+
+    // The contact may pull back what it pushed earlier, but never pull in total
+    float normalSpeed = Vector2DotProduct(RelativeVelocity(bodies, a, b), normal);
+    previous = constraint.normalImpulse;
+    constraint.normalImpulse = fmaxf(previous + (constraint.bias - normalSpeed) * constraint.normalMass, 0.0f);
+    ApplyImpulse(bodies, a, b, normal * (constraint.normalImpulse - previous));
+}
+
+void ContactSolver::finish(const BodyStore& bodies, float dt, DebugDraw& debugDraw)
+{
+    cache.resize(batched.size());
+    for (int i = 0; i < batched.size(); i++)
+    {
+        int from = batchedFrom[i];
+        cache[from] = { keys[from], generations[from], batched[i].normalImpulse, batched[i].tangentImpulse };
+    }
+
+    if (!debugDraw.isEnabled(DEBUG_DRAW_NORMAL) && !debugDraw.isEnabled(DEBUG_DRAW_FRICTION)) return;
+
+    // Plane impulses are shown as the average force they applied over the step
+    for (int i = 0; i < batched.size(); i++)
+    {
+        const Constraint& constraint = batched[i];
+        if (constraint.a != -1) continue;
+
+        Vector2 position = bodies.position[constraint.b];
+        Vector2 tangent = { -constraint.normal.y, constraint.normal.x };
+        Vector2 normalForce = constraint.normal * (constraint.normalImpulse / dt);
+        Vector2 frictionForce = tangent * (constraint.tangentImpulse / dt);
+        debugDraw.arrow(DEBUG_DRAW_NORMAL, position, position + normalForce, 2, GREEN);
+        debugDraw.arrow(DEBUG_DRAW_FRICTION, position, position + frictionForce, 2, ORANGE);
+    }
+}
+
+int ContactSolver::getConstraintCount() const
+{
+    return (int)constraints.size();
+}
+
+int ContactSolver::getWarmStartedCount() const
+{
+    return warmStarted;
+}
+
+int ContactSolver::getColorCount() const
+{
+    return colorCount;
+}
+
+const std::vector<int>& ContactSolver::getBatchSizes() const
+{
+    return batchSizes;
+}
+
+int ContactSolver::getOverflowCount() const
+{
+    return batchStart.size() < 2 ? 0 : batchStart.back() - batchStart[batchStart.size() - 2];
+}
@@ -0,0 +1,38 @@
+#include "debugdraw.h"
+#include <cstdarg>
+#include <cstdio>
+
+void DebugDraw::clear()
+{
+    lines.clear();
+    texts.clear();
+}
+
+void DebugDraw::text(DebugDrawCategory category, Vector2 position, int fontSize, Color color, const char* format, ...)
+{
+    if (!enabled[category]) return;
+
+    texts.push_back({});
+    Text& entry = texts.back();
+    entry.position = position;
+    entry.fontSize = fontSize;
+    entry.color = color;
+    entry.category = (unsigned char)category;
+
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(entry.text, sizeof(entry.text), format, arguments);
+    va_end(arguments);
+}
+
+const char* DebugDrawCategoryName(DebugDrawCategory category)
+{
+    switch (category)
+    {
+    case DEBUG_DRAW_GRAVITY: return "Gravity";
+    case DEBUG_DRAW_NET_FORCE: return "Net Force";
+    case DEBUG_DRAW_NORMAL: return "Normal";
+    case DEBUG_DRAW_FRICTION: return "Friction";
+    default: return "";
+    }
+}
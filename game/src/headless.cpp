@@ -0,0 +1,796 @@
+/*
+Headless benchmark. Runs a scenario through the physics core without opening a window, then prints
+the step rate and where the time went.
+
+    physics-1-headless --scenario rain --steps 1000 --bodies 2000 --broadphase grid
+
+--verify-kernels checks every SIMD kernel level against the scalar one and --bench-kernels times
+them, instead of running a scenario.
+
+--check-allocations exits with 1 if any step after the first made a heap allocation, which is
+what reserve() and the reused scratch buffers are there to prevent.
+
+--suite runs every scenario with the same settings and reports the spread of the step times, as
+CSV with --csv. Given the CSV of an earlier run with --baseline, it flags every scenario whose median
+step got slower by more than --threshold percent and exits with 1.
+
+--physics-thread steps the scenario on a PhysicsThread as fast as it goes, while this thread plays
+the renderer: it reads a snapshot every frame and stalls now and then like a slow frame would. Bodies
+a scenario spawns while it runs are not added in this mode.
+*/
+
+#include "physics.h"
+#include "scenarios.h"
+#include "physicsthread.h"
+#include "profiler.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+
+struct BenchmarkOptions
+{
+    std::string scenario = "rain";
+    int steps = 1000;
+    int bodies = 1000;
+    unsigned int seed = 1;
+    float rate = 50;
+    int substeps = 1;
+    int threads = 1;
+    int iterations = 8;
+    bool warmStarting = true;
+    bool sleeping = true;
+    bool continuousCollision = true;
+    KernelLevel kernelLevel = DetectKernelLevel();
+    bool verifyKernels = false;
+    bool benchKernels = false;
+    bool physicsThread = false;
+    bool profile = false;
+    bool checkAllocations = false;
+    std::string tracePath;
+    int traceFrames = 60;
+    bool suite = false;
+    std::string csvPath;
+    std::string baselinePath;
+    float threshold = 10;
+    BroadPhase broadPhase = SPATIAL_HASH;
+};
+
+static void PrintUsage()
+{
+    printf("usage: physics-1-headless [options]\n");
+    printf("  --scenario <name>     ");
+    for (const std::string& name : ScenarioNames()) printf("%s ", name.c_str());
+    printf("(default rain)\n");
+    printf("  --steps <count>       steps to simulate (default 1000)\n");
+    printf("  --bodies <count>      circles in the scenario (default 1000)\n");
+    printf("  --broadphase <name>   brute, grid, sap or tree (default grid)\n");
+    printf("  --seed <number>       random seed (default 1)\n");
+    printf("  --rate <hz>           physics rate (default 50)\n");
+    printf("  --substeps <count>    substeps per step, sharing one broad-phase pass (default 1)\n");
+    printf("  --threads <count>     job system threads including the main one (default 1)\n");
+    printf("  --iterations <count>  contact solver iterations (default 8)\n");
+    printf("  --warmstart <on|off>  start the solver from last step's impulses (default on)\n");
+    printf("  --sleep <on|off>      put resting islands to sleep (default on)\n");
+    printf("  --ccd <on|off>        sweep fast bodies and bullets (default on)\n");
+    printf("  --kernels <level>     scalar, sse2 or avx2 (default %s)\n", KernelLevelName(DetectKernelLevel()));
+    printf("  --verify-kernels      compare the SIMD kernels with the scalar ones and exit\n");
+    printf("  --bench-kernels       time the kernels at every supported level and exit\n");
+    printf("  --physics-thread      step on a physics thread while a simulated renderer reads it\n");
+    printf("  --profile             print the profiler zones of the last %d steps\n", PROFILER_HISTORY);
+    printf("  --check-allocations   fail if any step after the first allocates\n");
+    printf("  --suite               run every scenario and report step time percentiles\n");
+    printf("  --csv <file>          write the suite results as CSV\n");
+    printf("  --baseline <file>     compare the suite with an earlier CSV\n");
+    printf("  --threshold <percent> median slowdown that counts as a regression (default 10)\n");
+    printf("  --trace <file>        write a Chrome trace of the first frames (steps, or renderer\n");
+    printf("                        frames with --physics-thread)\n");
+    printf("  --trace-frames <n>    frames to trace (default 60)\n");
+}
+
+static bool ParseBroadPhase(const char* name, BroadPhase& broadPhase)
+{
+    if (strcmp(name, "brute") == 0) broadPhase = BRUTE_FORCE;
+    else if (strcmp(name, "grid") == 0) broadPhase = SPATIAL_HASH;
+    else if (strcmp(name, "sap") == 0) broadPhase = SWEEP_AND_PRUNE;
+    else if (strcmp(name, "tree") == 0) broadPhase = AABB_TREE;
+    else return false;
+    return true;
+}
+
+static bool ParseKernelLevel(const char* name, KernelLevel& level)
+{
+    for (int i = 0; i < KERNEL_LEVEL_COUNT; i++)
+    {
+        if (strcmp(name, KernelLevelName((KernelLevel)i)) == 0)
+        {
+            level = (KernelLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char* BroadPhaseName(BroadPhase broadPhase)
+{
+    switch (broadPhase)
+    {
+    case BRUTE_FORCE: return "brute";
+    case SPATIAL_HASH: return "grid";
+    case SWEEP_AND_PRUNE: return "sap";
+    default: return "tree";
+    }
+}
+
+static bool ParseArguments(int argc, char** argv, BenchmarkOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* argument = argv[i];
+        if (strcmp(argument, "--help") == 0 || strcmp(argument, "-h") == 0) return false;
+        if (strcmp(argument, "--verify-kernels") == 0)
+        {
+            options.verifyKernels = true;
+            continue;
+        }
+        if (strcmp(argument, "--bench-kernels") == 0)
+        {
+            options.benchKernels = true;
+            continue;
+        }
+        if (strcmp(argument, "--physics-thread") == 0)
+        {
+            options.physicsThread = true;
+            continue;
+        }
+        if (strcmp(argument, "--profile") == 0)
+        {
+            options.profile = true;
+            continue;
+        }
+        if (strcmp(argument, "--check-allocations") == 0)
+        {
+            options.checkAllocations = true;
+            continue;
+        }
+        if (strcmp(argument, "--suite") == 0)
+        {
+            options.suite = true;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "missing value for %s\n", argument);
+            return false;
+        }
+        const char* value = argv[++i];
+
+        if (strcmp(argument, "--scenario") == 0) options.scenario = value;
+        else if (strcmp(argument, "--steps") == 0) options.steps = atoi(value);
+        else if (strcmp(argument, "--bodies") == 0) options.bodies = atoi(value);
+        else if (strcmp(argument, "--seed") == 0) options.seed = (unsigned int)strtoul(value, nullptr, 10);
+        else if (strcmp(argument, "--rate") == 0) options.rate = (float)atof(value);
+        else if (strcmp(argument, "--substeps") == 0) options.substeps = atoi(value);
+        else if (strcmp(argument, "--threads") == 0) options.threads = atoi(value);
+        else if (strcmp(argument, "--iterations") == 0) options.iterations = atoi(value);
+        else if (strcmp(argument, "--warmstart") == 0) options.warmStarting = strcmp(value, "off") != 0;
+        else if (strcmp(argument, "--sleep") == 0) options.sleeping = strcmp(value, "off") != 0;
+        else if (strcmp(argument, "--csv") == 0) options.csvPath = value;
+        else if (strcmp(argument, "--baseline") == 0) options.baselinePath = value;
+        else if (strcmp(argument, "--threshold") == 0) options.threshold = (float)atof(value);
+        else if (strcmp(argument, "--trace") == 0) options.tracePath = value;
+        else if (strcmp(argument, "--trace-frames") == 0) options.traceFrames = atoi(value);
+        else if (strcmp(argument, "--ccd") == 0) options.continuousCollision = strcmp(value, "off") != 0;
+        else if (strcmp(argument, "--kernels") == 0)
+        {
+            if (!ParseKernelLevel(value, options.kernelLevel))
+            {
+                fprintf(stderr, "unknown kernel level %s\n", value);
+                return false;
+            }
+            if (!IsKernelLevelSupported(options.kernelLevel))
+            {
+                fprintf(stderr, "%s kernels are not supported on this machine\n", value);
+                return false;
+            }
+        }
+        else if (strcmp(argument, "--broadphase") == 0)
+        {
+            if (!ParseBroadPhase(value, options.broadPhase))
+            {
+                fprintf(stderr, "unknown broadphase %s\n", value);
+                return false;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", argument);
+            return false;
+        }
+    }
+
+    if (options.steps <= 0 || options.bodies < 0 || options.rate <= 0 || options.substeps < 1 || options.threads < 1 || options.iterations < 0)
+    {
+        fprintf(stderr, "steps, rate, substeps and threads must be positive\n");
+        return false;
+    }
+    return true;
+}
+
+static void PrintProfile()
+{
+    std::vector<ProfileThreadStats> stats;
+    ProfilerGetStats(stats);
+    for (const ProfileThreadStats& thread : stats)
+    {
+        printf("zones on %s, last %d frames, %.4f ms mean, %.4f ms max per frame:\n", thread.name.c_str(), (int)thread.frameMs.size(), thread.meanFrameMs, thread.maxFrameMs);
+        for (const ProfileZoneStats& zone : thread.zones)
+        {
+            printf("  %*s%-*s %10.4f ms mean %10.4f ms max\n", zone.depth * 2, "", 28 - zone.depth * 2, zone.name, zone.meanMs, zone.maxMs);
+        }
+    }
+}
+
+// Waits for the trace to be written. A run shorter than the capture still has it written.
+static void FinishTrace(const BenchmarkOptions& options)
+{
+    if (options.tracePath.empty()) return;
+    while (ProfilerCapturing())
+    {
+        ProfilerFlush("Physics");
+    }
+    ProfilerFinishWrites();
+    if (ProfilerTracesWritten() > 0) printf("trace written to %s\n", options.tracePath.c_str());
+}
+
+static void PrintStage(const char* name, double seconds, const StageTimings& timings, double total)
+{
+    printf("  %-16s %10.2f ms %10.4f ms/step %6.1f%%\n", name, seconds * 1000.0, seconds * 1000.0 / timings.steps, total > 0 ? seconds / total * 100.0 : 0.0);
+}
+
+// Random body arrays for the kernel checks, with every fourth body or so static or asleep
+struct KernelInput
+{
+    std::vector<Vector2> position;
+    std::vector<Vector2> velocity;
+    std::vector<Vector2> force;
+    std::vector<float> mass;
+    std::vector<float> invMass;
+    std::vector<unsigned char> flags;
+
+    KernelInput(int count, unsigned int seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> value(-500, 500);
+        std::uniform_real_distribution<float> weight(0.1f, 10);
+        for (int i = 0; i < count; i++)
+        {
+            position.push_back({ value(random), value(random) });
+            velocity.push_back({ value(random), value(random) });
+            force.push_back({ value(random), value(random) });
+            mass.push_back(weight(random));
+            invMass.push_back(1.0f / mass.back());
+            unsigned int roll = random() % 8;
+            flags.push_back(roll == 0 ? BODY_STATIC : roll == 1 ? BODY_SLEEPING : 0);
+        }
+    }
+};
+
+// Bodies in twos, the second at a random distance from the first so that about hitRate of the
+// pairs touch
+struct PairInput
+{
+    BodyStore bodies;
+    std::vector<CandidatePair> pairs;
+
+    PairInput(int count, float hitRate, unsigned int seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> unit(0, 1);
+        for (int i = 0; i < count; i++)
+        {
+            Vector2 center = { unit(random) * 4000, unit(random) * 4000 };
+            float radiusA = 4 + unit(random) * 6;
+            float radiusB = 4 + unit(random) * 6;
+            float distance = (radiusA + radiusB) * unit(random) / hitRate;
+            float angle = unit(random) * 2 * PI;
+            bodies.add(center, { 0,0 }, radiusA, 1, 0.5f, 2 * i);
+            bodies.add(center + Vector2{ cosf(angle), sinf(angle) } * distance, { 0,0 }, radiusB, 1, 0.5f, 2 * i + 1);
+            pairs.push_back({ 2 * i, 2 * i + 1 });
+        }
+    }
+
+    int overlapping(std::vector<int>& found) const
+    {
+        found.resize(pairs.size());
+        return OverlappingPairs(pairs.data(), (int)pairs.size(), bodies.position.data(), bodies.radius.data(), found.data());
+    }
+};
+
+static const unsigned char KERNEL_SKIP = BODY_STATIC | BODY_SLEEPING;
+static const Vector2 KERNEL_GRAVITY = { 3.5f, 200 };
+static const float KERNEL_DT = 1.0f / 50;
+
+static void RunKernels(const BodyKernels& kernels, KernelInput& input, int begin, int end)
+{
+    int count = end - begin;
+    kernels.addGravity(input.force.data() + begin, input.mass.data() + begin, input.flags.data() + begin, KERNEL_SKIP, count, KERNEL_GRAVITY);
+    kernels.applyForces(input.velocity.data() + begin, input.force.data() + begin, input.invMass.data() + begin, input.flags.data() + begin, KERNEL_SKIP, count, KERNEL_DT);
+    kernels.integratePositions(input.position.data() + begin, input.velocity.data() + begin, input.flags.data() + begin, KERNEL_SKIP, count, KERNEL_DT);
+}
+
+// Every level must give the scalar results bit for bit, over ranges of every length and alignment
+// so the remainder loops are covered too
+static bool VerifyKernels()
+{
+    bool passed = true;
+    for (int level = KERNEL_SSE2; level < KERNEL_LEVEL_COUNT; level++)
+    {
+        if (!IsKernelLevelSupported((KernelLevel)level))
+        {
+            printf("%-8s not supported, skipped\n", KernelLevelName((KernelLevel)level));
+            continue;
+        }
+
+        int mismatches = 0;
+        for (int begin = 0; begin < 4; begin++)
+        {
+            for (int end = begin; end < 80; end++)
+            {
+                KernelInput expected(80, begin * 100 + end);
+                KernelInput actual = expected;
+                RunKernels(GetBodyKernels(KERNEL_SCALAR), expected, begin, end);
+                RunKernels(GetBodyKernels((KernelLevel)level), actual, begin, end);
+
+                bool same = memcmp(expected.position.data(), actual.position.data(), expected.position.size() * sizeof(Vector2)) == 0;
+                same = same && memcmp(expected.velocity.data(), actual.velocity.data(), expected.velocity.size() * sizeof(Vector2)) == 0;
+                same = same && memcmp(expected.force.data(), actual.force.data(), expected.force.size() * sizeof(Vector2)) == 0;
+                if (!same) mismatches++;
+            }
+        }
+
+        printf("%-8s %s\n", KernelLevelName((KernelLevel)level), mismatches == 0 ? "matches scalar" : "MISMATCH");
+        passed = passed && mismatches == 0;
+    }
+    return passed;
+}
+
+static void BenchKernels()
+{
+    const int count = 1 << 16;
+    const int repeats = 500;
+    KernelInput input(count, 1);
+    printf("%d bodies, %d repeats, ns per body:\n", count, repeats);
+    printf("  %-8s %10s %10s %10s\n", "level", "gravity", "forces", "positions");
+
+    double scalarTotal = 0;
+    for (int level = 0; level < KERNEL_LEVEL_COUNT; level++)
+    {
+        if (!IsKernelLevelSupported((KernelLevel)level)) continue;
+        const BodyKernels& kernels = GetBodyKernels((KernelLevel)level);
+
+        double seconds[3] = { 0, 0, 0 };
+        for (int repeat = 0; repeat < repeats; repeat++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            kernels.addGravity(input.force.data(), input.mass.data(), input.flags.data(), KERNEL_SKIP, count, KERNEL_GRAVITY);
+            auto gravityDone = std::chrono::steady_clock::now();
+            kernels.applyForces(input.velocity.data(), input.force.data(), input.invMass.data(), input.flags.data(), KERNEL_SKIP, count, KERNEL_DT);
+            auto forcesDone = std::chrono::steady_clock::now();
+            kernels.integratePositions(input.position.data(), input.velocity.data(), input.flags.data(), KERNEL_SKIP, count, KERNEL_DT);
+            auto positionsDone = std::chrono::steady_clock::now();
+
+            seconds[0] += std::chrono::duration<double>(gravityDone - start).count();
+            seconds[1] += std::chrono::duration<double>(forcesDone - gravityDone).count();
+            seconds[2] += std::chrono::duration<double>(positionsDone - forcesDone).count();
+            // Keep the values from growing without bound over the repeats
+            std::fill(input.force.begin(), input.force.end(), Vector2{ 0,0 });
+        }
+
+        double scale = 1e9 / ((double)count * repeats);
+        double total = seconds[0] + seconds[1] + seconds[2];
+        if (level == KERNEL_SCALAR) scalarTotal = total;
+        printf("  %-8s %10.3f %10.3f %10.3f   %.2fx\n", KernelLevelName((KernelLevel)level), seconds[0] * scale, seconds[1] * scale, seconds[2] * scale, scalarTotal / total);
+    }
+
+    // Narrow-phase over a candidate list: a contact test per pair, as before the filter, against
+    // the filter followed by contacts for the pairs that passed. Pairs come in body order, as they
+    // mostly do from the broad-phases, and the bodies fit in cache.
+    const float hitRates[] = { 0.02f, 0.1f, 0.5f };
+    const int pairCount = 1 << 12;
+    const int pairRepeats = repeats * 4;
+    printf("%d candidate pairs, %d repeats, ns per pair:\n", pairCount, pairRepeats);
+    printf("  %-8s", "hit rate");
+    for (float hitRate : hitRates) printf(" %15.0f%%", hitRate * 100);
+    printf("\n");
+
+    std::vector<double> perPairTimes;
+    for (int filtered = 0; filtered < 2; filtered++)
+    {
+        printf("  %-8s", filtered ? "filtered" : "per pair");
+
+        for (int rate = 0; rate < 3; rate++)
+        {
+            PairInput pairInput(pairCount, hitRates[rate], 1);
+            std::vector<int> overlapping;
+            std::vector<Contact> contacts;
+            Contact contact;
+            auto start = std::chrono::steady_clock::now();
+            for (int repeat = 0; repeat < pairRepeats; repeat++)
+            {
+                contacts.clear();
+                if (!filtered)
+                {
+                    for (const CandidatePair& pair : pairInput.pairs)
+                    {
+                        if (CircleCircleContact(pairInput.bodies, pair.a, pair.b, contact)) contacts.push_back(contact);
+                    }
+                    continue;
+                }
+
+                int found = pairInput.overlapping(overlapping);
+                for (int i = 0; i < found; i++)
+                {
+                    const CandidatePair& pair = pairInput.pairs[overlapping[i]];
+                    if (CircleCircleContact(pairInput.bodies, pair.a, pair.b, contact)) contacts.push_back(contact);
+                }
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            double perPair = seconds * 1e9 / ((double)pairCount * pairRepeats);
+            if (!filtered)
+            {
+                perPairTimes.push_back(perPair);
+                printf(" %8.3f        ", perPair);
+            }
+            else
+            {
+                printf(" %8.3f (%4.1fx)", perPair, perPairTimes[rate] / perPair);
+            }
+        }
+        printf("\n");
+    }
+}
+
+// Runs that should be identical, such as the same scenario with different thread counts, must print
+// the same checksum
+static double PositionChecksum(const BodyStore& bodies)
+{
+    double sum = 0;
+    for (int i = 0; i < bodies.size(); i++)
+    {
+        sum += bodies.position[i].x * (i % 7 + 1) + bodies.position[i].y * (i % 5 + 1);
+    }
+    return sum;
+}
+
+// The renderer side of --physics-thread. Frames take 1/60 s and every 30th one stalls for 100 ms;
+// the physics thread should keep its step rate through both. Every snapshot is checked to be whole
+// and newer than or the same as the last one. The unchanged settings are sent every frame, like the
+// GUI does on a change, so the command queue is exercised without changing the run.
+static bool RunOnPhysicsThread(Scenario& scenario, const BenchmarkOptions& options)
+{
+    PhysicsThread physicsThread(scenario.world);
+    physicsThread.realTime = false;
+    physicsThread.stepLimit = options.steps;
+    PhysicsCommand command;
+    command.type = COMMAND_SETTINGS;
+    command.settings = CaptureSettings(scenario.world);
+
+    int frames = 0;
+    int stalls = 0;
+    int broken = 0;
+    long long stepsSeen = 0;
+    long long lastStep = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    if (!options.tracePath.empty()) ProfilerStartCapture(options.traceFrames, options.tracePath);
+    physicsThread.start();
+    while (lastStep < options.steps)
+    {
+        const RenderSnapshot& snapshot = physicsThread.latestSnapshot();
+        int count = snapshot.size();
+        bool whole = (int)snapshot.velocity.size() == count && (int)snapshot.radius.size() == count && (int)snapshot.color.size() == count && (int)snapshot.serial.size() == count && (int)snapshot.previousPosition.size() == count;
+        if (!whole || snapshot.step < lastStep) broken++;
+        stepsSeen += snapshot.step - lastStep;
+        lastStep = snapshot.step;
+
+        physicsThread.send(command);
+        ProfilerFlush("Render");
+        frames++;
+        bool stall = frames % 30 == 0;
+        if (stall) stalls++;
+        std::this_thread::sleep_for(std::chrono::microseconds(stall ? 100000 : 16667));
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    physicsThread.stop();
+
+    printf("physics thread: %d steps in %.3f s, %.1f steps/s\n", options.steps, elapsed, options.steps / elapsed);
+    printf("renderer: %d frames (%d stalled), %.1f fps, %.1f steps per frame, %d broken snapshots\n", frames, stalls, frames / elapsed, (double)stepsSeen / frames, broken);
+    printf("position checksum %.6f\n", PositionChecksum(scenario.world.bodies));
+    if (options.profile) PrintProfile();
+    FinishTrace(options);
+    return broken == 0;
+}
+
+// Set up with the options, or nullptr for an unknown name
+static std::unique_ptr<Scenario> CreateConfiguredScenario(const std::string& name, const BenchmarkOptions& options)
+{
+    std::unique_ptr<Scenario> scenario = CreateScenario(name);
+    if (!scenario) return nullptr;
+
+    scenario->bodyCount = options.bodies;
+    scenario->seed = options.seed;
+    scenario->setup();
+    scenario->world.broadPhase = options.broadPhase;
+    scenario->world.dt = 1.0f / options.rate;
+    scenario->world.substeps = options.substeps;
+    scenario->world.jobs.setThreadCount(options.threads);
+    scenario->world.solver.iterations = options.iterations;
+    scenario->world.solver.warmStarting = options.warmStarting;
+    scenario->world.sleepingEnabled = options.sleeping;
+    scenario->world.continuousCollision = options.continuousCollision;
+    scenario->world.kernelLevel = options.kernelLevel;
+    return scenario;
+}
+
+struct SuiteResult
+{
+    std::string scenario;
+    int bodies = 0;
+    int steps = 0;
+    double meanMs = 0;
+    double p50Ms = 0;
+    double p90Ms = 0;
+    double p99Ms = 0;
+    double maxMs = 0;
+    // Per step, averaged over the run
+    double pairsTested = 0;
+    double contacts = 0;
+    double checksum = 0;
+};
+
+static const char* SUITE_CSV_HEADER = "scenario,bodies,steps,mean_ms,p50_ms,p90_ms,p99_ms,max_ms,pairs_tested,contacts,checksum";
+
+// Nearest rank on sorted times
+static double Percentile(const std::vector<double>& sorted, double percent)
+{
+    int rank = (int)ceil(percent / 100.0 * sorted.size());
+    return sorted[std::min(std::max(rank, 1), (int)sorted.size()) - 1];
+}
+
+static SuiteResult RunSuiteScenario(Scenario& scenario, const BenchmarkOptions& options)
+{
+    SuiteResult result;
+    result.scenario = scenario.getName();
+    result.steps = options.steps;
+
+    std::vector<double> stepMs(options.steps);
+    for (int i = 0; i < options.steps; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        scenario.step();
+        stepMs[i] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        ProfilerFlush("Physics");
+
+        result.meanMs += stepMs[i];
+        result.pairsTested += scenario.world.pairsTested;
+        result.contacts += scenario.world.solver.getConstraintCount();
+    }
+    result.meanMs /= options.steps;
+    result.pairsTested /= options.steps;
+    result.contacts /= options.steps;
+
+    std::sort(stepMs.begin(), stepMs.end());
+    result.p50Ms = Percentile(stepMs, 50);
+    result.p90Ms = Percentile(stepMs, 90);
+    result.p99Ms = Percentile(stepMs, 99);
+    result.maxMs = stepMs.back();
+    result.bodies = scenario.world.bodies.size();
+    result.checksum = PositionChecksum(scenario.world.bodies);
+    return result;
+}
+
+static void WriteSuiteRow(FILE* file, const SuiteResult& result)
+{
+    fprintf(file, "%s,%d,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.1f,%.1f,%.6f\n", result.scenario.c_str(), result.bodies, result.steps, result.meanMs, result.p50Ms, result.p90Ms, result.p99Ms, result.maxMs, result.pairsTested, result.contacts, result.checksum);
+}
+
+// Scenario name to its row, from a CSV written by --csv. Returns false when the file cannot be read.
+static bool ReadSuiteCsv(const std::string& path, std::map<std::string, SuiteResult>& results)
+{
+    std::ifstream file(path);
+    if (!file) return false;
+
+    std::string line;
+    std::getline(file, line);
+    while (std::getline(file, line))
+    {
+        std::stringstream fields(line);
+        std::string field;
+        std::vector<std::string> values;
+        while (std::getline(fields, field, ',')) values.push_back(field);
+        if (values.size() < 11) continue;
+
+        SuiteResult result;
+        result.scenario = values[0];
+        result.bodies = atoi(values[1].c_str());
+        result.steps = atoi(values[2].c_str());
+        result.meanMs = atof(values[3].c_str());
+        result.p50Ms = atof(values[4].c_str());
+        result.p90Ms = atof(values[5].c_str());
+        result.p99Ms = atof(values[6].c_str());
+        result.maxMs = atof(values[7].c_str());
+        result.pairsTested = atof(values[8].c_str());
+        result.contacts = atof(values[9].c_str());
+        result.checksum = atof(values[10].c_str());
+        results[result.scenario] = result;
+    }
+    return true;
+}
+
+// Returns false when a scenario regressed or the baseline cannot be read
+static bool CompareWithBaseline(const std::vector<SuiteResult>& results, const BenchmarkOptions& options)
+{
+    std::map<std::string, SuiteResult> baseline;
+    if (!ReadSuiteCsv(options.baselinePath, baseline))
+    {
+        fprintf(stderr, "could not read baseline %s\n", options.baselinePath.c_str());
+        return false;
+    }
+
+    printf("against %s, regression threshold %.1f%% on the median:\n", options.baselinePath.c_str(), options.threshold);
+    bool passed = true;
+    for (const SuiteResult& result : results)
+    {
+        auto found = baseline.find(result.scenario);
+        if (found == baseline.end())
+        {
+            printf("  %-8s not in the baseline\n", result.scenario.c_str());
+            continue;
+        }
+
+        const SuiteResult& base = found->second;
+        double change = base.p50Ms > 0 ? (result.p50Ms / base.p50Ms - 1.0) * 100.0 : 0.0;
+        bool regressed = change > options.threshold;
+        if (regressed) passed = false;
+        // A different outcome means a different workload, so the times may not be comparable
+        bool sameRun = result.steps == base.steps && result.bodies == base.bodies && fabs(result.checksum - base.checksum) <= 1e-3 * fabs(base.checksum) + 1e-6;
+        printf("  %-8s p50 %8.4f ms vs %8.4f ms %+7.1f%%  p99 %8.4f ms vs %8.4f ms%s%s\n", result.scenario.c_str(), result.p50Ms, base.p50Ms, change, result.p99Ms, base.p99Ms, regressed ? "  REGRESSION" : "", sameRun ? "" : "  (different run)");
+    }
+    return passed;
+}
+
+static bool RunSuite(const BenchmarkOptions& options)
+{
+    printf("suite, %d bodies, broadphase %s, %d steps at %.0f Hz x %d substeps, seed %u, %d threads, %d solver iterations, %s kernels\n", options.bodies, BroadPhaseName(options.broadPhase), options.steps, options.rate, options.substeps, options.seed, options.threads, options.iterations, KernelLevelName(options.kernelLevel));
+
+    std::vector<SuiteResult> results;
+    for (const std::string& name : ScenarioNames())
+    {
+        std::unique_ptr<Scenario> scenario = CreateConfiguredScenario(name, options);
+        results.push_back(RunSuiteScenario(*scenario, options));
+    }
+
+    printf("%s\n", SUITE_CSV_HEADER);
+    for (const SuiteResult& result : results) WriteSuiteRow(stdout, result);
+
+    if (!options.csvPath.empty())
+    {
+        FILE* file = fopen(options.csvPath.c_str(), "w");
+        if (file == nullptr)
+        {
+            fprintf(stderr, "could not write %s\n", options.csvPath.c_str());
+            return false;
+        }
+        fprintf(file, "%s\n", SUITE_CSV_HEADER);
+        for (const SuiteResult& result : results) WriteSuiteRow(file, result);
+        fclose(file);
+        printf("wrote %s\n", options.csvPath.c_str());
+    }
+
+    if (options.baselinePath.empty()) return true;
+    return CompareWithBaseline(results, options);
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkOptions options;
+    if (!ParseArguments(argc, argv, options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    if (options.verifyKernels) return VerifyKernels() ? 0 : 1;
+    if (options.benchKernels)
+    {
+        BenchKernels();
+        return 0;
+    }
+
+    if (options.suite) return RunSuite(options) ? 0 : 1;
+
+    std::unique_ptr<Scenario> scenario = CreateConfiguredScenario(options.scenario, options);
+    if (!scenario)
+    {
+        fprintf(stderr, "unknown scenario %s\n", options.scenario.c_str());
+        PrintUsage();
+        return 1;
+    }
+
+    printf("scenario %s, %d bodies, broadphase %s, %d steps at %.0f Hz x %d substeps, seed %u, %d threads, %d solver iterations%s, %s kernels\n", scenario->getName(), scenario->world.bodies.size(), BroadPhaseName(options.broadPhase), options.steps, options.rate, options.substeps, options.seed, options.threads, options.iterations, options.warmStarting ? "" : " (no warm start)", KernelLevelName(options.kernelLevel));
+
+    if (options.physicsThread) return RunOnPhysicsThread(*scenario, options) ? 0 : 1;
+
+    if (!options.tracePath.empty()) ProfilerStartCapture(options.traceFrames, options.tracePath);
+    // The first step sizes whatever reserve() left out, every step after it should reuse that
+    int allocatingSteps = 0;
+    int firstAllocatingStep = -1;
+    long long warmAllocations = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < options.steps; i++)
+    {
+        scenario->step();
+        ProfilerFlush("Physics");
+
+        long long allocations = scenario->world.stepStats.allocations;
+        if (i == 0 || allocations == 0) continue;
+        if (allocatingSteps++ == 0) firstAllocatingStep = i;
+        warmAllocations += allocations;
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const StageTimings& timings = scenario->world.timings;
+    double staged = timings.resetNetForce + timings.gravity + timings.halfspaces + timings.broadPhase + timings.narrowPhase + timings.solver + timings.continuous + timings.kinematics + timings.sleeping;
+
+    printf("%d steps in %.3f s, %.1f steps/s, %.4f ms/step\n", options.steps, elapsed, options.steps / elapsed, elapsed * 1000.0 / options.steps);
+    printf("stages:\n");
+    PrintStage("reset forces", timings.resetNetForce, timings, staged);
+    PrintStage("gravity", timings.gravity, timings, staged);
+    PrintStage("halfspaces", timings.halfspaces, timings, staged);
+    PrintStage("broad-phase", timings.broadPhase, timings, staged);
+    PrintStage("narrow-phase", timings.narrowPhase, timings, staged);
+    PrintStage("solver", timings.solver, timings, staged);
+    PrintStage("continuous", timings.continuous, timings, staged);
+    PrintStage("kinematics", timings.kinematics, timings, staged);
+    PrintStage("sleeping", timings.sleeping, timings, staged);
+
+    // What a step costs whatever the substep count, and what each substep adds to it
+    double perStep = timings.resetNetForce + timings.gravity + timings.broadPhase + timings.sleeping;
+    double perSubstep = staged - perStep;
+    printf("once per step %.4f ms/step, per substep %.4f ms/substep x %d\n", perStep * 1000.0 / timings.steps, perSubstep * 1000.0 / timings.substeps, timings.substeps / timings.steps);
+    printf("bodies at end %d (%d awake, %d asleep), pairs tested last step %d\n", scenario->world.bodies.size(), scenario->world.awakeCount, scenario->world.sleepingCount, scenario->world.pairsTested);
+    printf("contacts last step %d, warm started %d\n", scenario->world.solver.getConstraintCount(), scenario->world.solver.getWarmStartedCount());
+    printf("swept last step %d, impacts %d, tunneled %d\n", scenario->world.sweptCount, scenario->world.impactCount, scenario->countTunneled());
+    const StepStats& stats = scenario->world.stepStats;
+    printf("last step: %d candidate pairs, %d narrow tests, %d contacts (%.1f%% of pairs), %d halfspace contacts, %d solver iterations, %d bodies integrated, %lld allocations\n", stats.candidatePairs, stats.narrowTests, stats.contacts, stats.efficiency() * 100, stats.halfspaceContacts, stats.solverIterations, stats.bodiesIntegrated, stats.allocations);
+
+    const ContactSolver& solver = scenario->world.solver;
+    printf("solver colors %d, overflow %d, batch sizes", solver.getColorCount(), solver.getOverflowCount());
+    for (int size : solver.getBatchSizes()) printf(" %d", size);
+    printf("\n");
+    printf("position checksum %.6f\n", PositionChecksum(scenario->world.bodies));
+    if (options.profile) PrintProfile();
+    FinishTrace(options);
+
+    if (options.checkAllocations)
+    {
+        if (allocatingSteps == 0)
+        {
+            printf("no allocations after the first step\n");
+        }
+        else
+        {
+            printf("ALLOCATIONS after the first step: %lld in %d steps, first at step %d\n", warmAllocations, allocatingSteps, firstAllocatingStep);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include "jobsystem.h"
+#include "profiler.h"
+#include <cstdio>
+
+static thread_local int CurrentWorker = 0;
+
+JobSystem::~JobSystem()
+{
+    stopThreads();
+}
+
+void JobSystem::setThreadCount(int count)
+{
+    if (count < 1) count = 1;
+    if (count == getThreadCount()) return;
+
+    stopThreads();
+
+    workers.clear();
+    for (int i = 0; i < count; i++)
+    {
+        workers.push_back(std::make_unique<Worker>());
+    }
+
+    stopping = false;
+    startedThreads = 0;
+    for (int i = 1; i < count; i++)
+    {
+        threads.emplace_back(&JobSystem::workerMain, this, i);
+    }
+
+    // What a worker allocates for itself is done before the first step, not during whichever step
+    // it first gets scheduled in
+    while (startedThreads.load() < count - 1) std::this_thread::yield();
+}
+
+int JobSystem::getThreadCount() const
+{
+    return (int)threads.size() + 1;
+}
+
+int JobSystem::currentWorker()
+{
+    return CurrentWorker;
+}
+
+void JobSystem::run(Loop& loop, int count)
+{
+    {
+        std::lock_guard<std::mutex> lock(workers[0]->mutex);
+        workers[0]->pushBack({ &loop, 0, count });
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        activeLoops++;
+        activeLoopsHint.store(activeLoops);
+    }
+    wake.notify_all();
+
+    // The caller helps until every index has run. Ranges still queued all belong to this loop.
+    while (loop.remaining.load(std::memory_order_acquire) > 0)
+    {
+        Range range;
+        if (findRange(0, range))
+            execute(0, range);
+        else
+            std::this_thread::yield();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        activeLoops--;
+        activeLoopsHint.store(activeLoops);
+    }
+}
+
+void JobSystem::workerMain(int index)
+{
+    CurrentWorker = index;
+    ProfilerInitThread();
+    startedThreads++;
+    char name[32];
+    snprintf(name, sizeof(name), "Worker %d", index);
+    while (true)
+    {
+        Range range;
+        if (findRange(index, range))
+        {
+            execute(index, range);
+            continue;
+        }
+
+        // Keep looking while a loop is running, its ranges are still being split
+        if (activeLoopsHint.load(std::memory_order_relaxed) > 0)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Workers have no frames, what they ran goes to a trace capture between loops
+        ProfilerCollect(name);
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || activeLoops > 0; });
+        if (stopping) return;
+    }
+}
+
+bool JobSystem::findRange(int index, Range& range)
+{
+    Worker& own = *workers[index];
+    {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.empty())
+        {
+            range = own.popBack();
+            return true;
+        }
+    }
+
+    int count = (int)workers.size();
+    for (int offset = 1; offset < count; offset++)
+    {
+        Worker& victim = *workers[(index + offset) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.empty())
+        {
+            range = victim.popFront();
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::execute(int index, Range range)
+{
+    Loop& loop = *range.loop;
+
+    // Leave the far half for thieves until the rest is small enough to run
+    while (range.end - range.begin > loop.grain)
+    {
+        int middle = range.begin + (range.end - range.begin) / 2;
+        {
+            std::lock_guard<std::mutex> lock(workers[index]->mutex);
+            workers[index]->pushBack({ range.loop, middle, range.end });
+        }
+        range.end = middle;
+    }
+
+    {
+        PROFILE_ZONE("job");
+        loop.invoke(loop.body, range.begin, range.end);
+    }
+    // The loop lives on the caller's stack, it must not be touched after this
+    loop.remaining.fetch_sub(range.end - range.begin, std::memory_order_acq_rel);
+}
+
+void JobSystem::stopThreads()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (int i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+    threads.clear();
+}
@@ -0,0 +1,300 @@
+#include "kernels.h"
+#include "raymath.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+static void AddGravityScalar(Vector2* force, const float* mass, const unsigned char* flags, unsigned char skip, int count, Vector2 gravity)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (flags[i] & skip) continue;
+        force[i] += gravity * mass[i];
+    }
+}
+
+static void ApplyForcesScalar(Vector2* velocity, const Vector2* force, const float* invMass, const unsigned char* flags, unsigned char skip, int count, float dt)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (flags[i] & skip) continue;
+        velocity[i] += force[i] * (invMass[i] * dt);
+    }
+}
+
+static void IntegratePositionsScalar(Vector2* position, const Vector2* velocity, const unsigned char* flags, unsigned char skip, int count, float dt)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (flags[i] & skip) continue;
+        position[i] += velocity[i] * dt;
+    }
+}
+
+#ifdef KERNELS_X86
+
+// Lane masks for 4 bodies, all ones where the body is not skipped. low covers the x and y lanes
+// of the first two bodies, high those of the other two.
+static inline void ActiveMasksSse2(const unsigned char* flags, unsigned char skip, __m128& low, __m128& high)
+{
+    int packed;
+    memcpy(&packed, flags, sizeof(packed));
+    __m128i skipped = _mm_and_si128(_mm_cvtsi32_si128(packed), _mm_set1_epi8((char)skip));
+    __m128i active = _mm_cmpeq_epi8(skipped, _mm_setzero_si128());
+    // Widen each body's byte to 32 bits, then to its two lanes
+    active = _mm_unpacklo_epi8(active, active);
+    active = _mm_unpacklo_epi16(active, active);
+    low = _mm_castsi128_ps(_mm_unpacklo_epi32(active, active));
+    high = _mm_castsi128_ps(_mm_unpackhi_epi32(active, active));
+}
+
+static inline __m128 SelectSse2(__m128 mask, __m128 chosen, __m128 otherwise)
+{
+    return _mm_or_ps(_mm_and_ps(mask, chosen), _mm_andnot_ps(mask, otherwise));
+}
+
+static void AddGravitySse2(Vector2* force, const float* mass, const unsigned char* flags, unsigned char skip, int count, Vector2 gravity)
+{
+    __m128 g = _mm_setr_ps(gravity.x, gravity.y, gravity.x, gravity.y);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 activeLow, activeHigh;
+        ActiveMasksSse2(flags + i, skip, activeLow, activeHigh);
+        __m128 m = _mm_loadu_ps(mass + i);
+
+        float* f = (float*)(force + i);
+        __m128 forceLow = _mm_loadu_ps(f);
+        __m128 forceHigh = _mm_loadu_ps(f + 4);
+        forceLow = SelectSse2(activeLow, _mm_add_ps(forceLow, _mm_mul_ps(g, _mm_unpacklo_ps(m, m))), forceLow);
+        forceHigh = SelectSse2(activeHigh, _mm_add_ps(forceHigh, _mm_mul_ps(g, _mm_unpackhi_ps(m, m))), forceHigh);
+        _mm_storeu_ps(f, forceLow);
+        _mm_storeu_ps(f + 4, forceHigh);
+    }
+    AddGravityScalar(force + i, mass + i, flags + i, skip, count - i, gravity);
+}
+
+static void ApplyForcesSse2(Vector2* velocity, const Vector2* force, const float* invMass, const unsigned char* flags, unsigned char skip, int count, float dt)
+{
+    __m128 step = _mm_set1_ps(dt);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 activeLow, activeHigh;
+        ActiveMasksSse2(flags + i, skip, activeLow, activeHigh);
+        __m128 scale = _mm_mul_ps(_mm_loadu_ps(invMass + i), step);
+
+        float* v = (float*)(velocity + i);
+        const float* f = (const float*)(force + i);
+        __m128 velocityLow = _mm_loadu_ps(v);
+        __m128 velocityHigh = _mm_loadu_ps(v + 4);
+        velocityLow = SelectSse2(activeLow, _mm_add_ps(velocityLow, _mm_mul_ps(_mm_loadu_ps(f), _mm_unpacklo_ps(scale, scale))), velocityLow);
+        velocityHigh = SelectSse2(activeHigh, _mm_add_ps(velocityHigh, _mm_mul_ps(_mm_loadu_ps(f + 4), _mm_unpackhi_ps(scale, scale))), velocityHigh);
+        _mm_storeu_ps(v, velocityLow);
+        _mm_storeu_ps(v + 4, velocityHigh);
+    }
+    ApplyForcesScalar(velocity + i, force + i, invMass + i, flags + i, skip, count - i, dt);
+}
+
+static void IntegratePositionsSse2(Vector2* position, const Vector2* velocity, const unsigned char* flags, unsigned char skip, int count, float dt)
+{
+    __m128 step = _mm_set1_ps(dt);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 activeLow, activeHigh;
+        ActiveMasksSse2(flags + i, skip, activeLow, activeHigh);
+
+        float* p = (float*)(position + i);
+        const float* v = (const float*)(velocity + i);
+        __m128 positionLow = _mm_loadu_ps(p);
+        __m128 positionHigh = _mm_loadu_ps(p + 4);
+        positionLow = SelectSse2(activeLow, _mm_add_ps(positionLow, _mm_mul_ps(_mm_loadu_ps(v), step)), positionLow);
+        positionHigh = SelectSse2(activeHigh, _mm_add_ps(positionHigh, _mm_mul_ps(_mm_loadu_ps(v + 4), step)), positionHigh);
+        _mm_storeu_ps(p, positionLow);
+        _mm_storeu_ps(p + 4, positionHigh);
+    }
+    IntegratePositionsScalar(position + i, velocity + i, flags + i, skip, count - i, dt);
+}
+
+// Spreads 8 per-body values over the x and y lanes of their bodies, 4 bodies per register
+TARGET_AVX2 static inline void SpreadAvx2(__m256i perBody, __m256i& low, __m256i& high)
+{
+    low = _mm256_permutevar8x32_epi32(perBody, _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3));
+    high = _mm256_permutevar8x32_epi32(perBody, _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7));
+}
+
+TARGET_AVX2 static inline void SpreadAvx2(__m256 perBody, __m256& low, __m256& high)
+{
+    __m256i lowBits, highBits;
+    SpreadAvx2(_mm256_castps_si256(perBody), lowBits, highBits);
+    low = _mm256_castsi256_ps(lowBits);
+    high = _mm256_castsi256_ps(highBits);
+}
+
+TARGET_AVX2 static inline void ActiveMasksAvx2(const unsigned char* flags, unsigned char skip, __m256& low, __m256& high)
+{
+    long long packed;
+    memcpy(&packed, flags, sizeof(packed));
+    __m128i skipped = _mm_and_si128(_mm_cvtsi64_si128(packed), _mm_set1_epi8((char)skip));
+    // Sign extension turns the all-ones bytes into all-ones lanes
+    __m256i active = _mm256_cvtepi8_epi32(_mm_cmpeq_epi8(skipped, _mm_setzero_si128()));
+    __m256i lowBits, highBits;
+    SpreadAvx2(active, lowBits, highBits);
+    low = _mm256_castsi256_ps(lowBits);
+    high = _mm256_castsi256_ps(highBits);
+}
+
+TARGET_AVX2 static void AddGravityAvx2(Vector2* force, const float* mass, const unsigned char* flags, unsigned char skip, int count, Vector2 gravity)
+{
+    __m256 g = _mm256_setr_ps(gravity.x, gravity.y, gravity.x, gravity.y, gravity.x, gravity.y, gravity.x, gravity.y);
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 activeLow, activeHigh, massLow, massHigh;
+        ActiveMasksAvx2(flags + i, skip, activeLow, activeHigh);
+        SpreadAvx2(_mm256_loadu_ps(mass + i), massLow, massHigh);
+
+        float* f = (float*)(force + i);
+        __m256 forceLow = _mm256_loadu_ps(f);
+        __m256 forceHigh = _mm256_loadu_ps(f + 8);
+        forceLow = _mm256_blendv_ps(forceLow, _mm256_add_ps(forceLow, _mm256_mul_ps(g, massLow)), activeLow);
+        forceHigh = _mm256_blendv_ps(forceHigh, _mm256_add_ps(forceHigh, _mm256_mul_ps(g, massHigh)), activeHigh);
+        _mm256_storeu_ps(f, forceLow);
+        _mm256_storeu_ps(f + 8, forceHigh);
+    }
+    AddGravitySse2(force + i, mass + i, flags + i, skip, count - i, gravity);
+}
+
+TARGET_AVX2 static void ApplyForcesAvx2(Vector2* velocity, const Vector2* force, const float* invMass, const unsigned char* flags, unsigned char skip, int count, float dt)
+{
+    __m256 step = _mm256_set1_ps(dt);
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 activeLow, activeHigh, scaleLow, scaleHigh;
+        ActiveMasksAvx2(flags + i, skip, activeLow, activeHigh);
+        SpreadAvx2(_mm256_mul_ps(_mm256_loadu_ps(invMass + i), step), scaleLow, scaleHigh);
+
+        float* v = (float*)(velocity + i);
+        const float* f = (const float*)(force + i);
+        __m256 velocityLow = _mm256_loadu_ps(v);
+        __m256 velocityHigh = _mm256_loadu_ps(v + 8);
+        velocityLow = _mm256_blendv_ps(velocityLow, _mm256_add_ps(velocityLow, _mm256_mul_ps(_mm256_loadu_ps(f), scaleLow)), activeLow);
+        velocityHigh = _mm256_blendv_ps(velocityHigh, _mm256_add_ps(velocityHigh, _mm256_mul_ps(_mm256_loadu_ps(f + 8), scaleHigh)), activeHigh);
+        _mm256_storeu_ps(v, velocityLow);
+        _mm256_storeu_ps(v + 8, velocityHigh);
+    }
+    ApplyForcesSse2(velocity + i, force + i, invMass + i, flags + i, skip, count - i, dt);
+}
+
+TARGET_AVX2 static void IntegratePositionsAvx2(Vector2* position, const Vector2* velocity, const unsigned char* flags, unsigned char skip, int count, float dt)
+{
+    __m256 step = _mm256_set1_ps(dt);
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 activeLow, activeHigh;
+        ActiveMasksAvx2(flags + i, skip, activeLow, activeHigh);
+
+        float* p = (float*)(position + i);
+        const float* v = (const float*)(velocity + i);
+        __m256 positionLow = _mm256_loadu_ps(p);
+        __m256 positionHigh = _mm256_loadu_ps(p + 8);
+        positionLow = _mm256_blendv_ps(positionLow, _mm256_add_ps(positionLow, _mm256_mul_ps(_mm256_loadu_ps(v), step)), activeLow);
+        positionHigh = _mm256_blendv_ps(positionHigh, _mm256_add_ps(positionHigh, _mm256_mul_ps(_mm256_loadu_ps(v + 8), step)), activeHigh);
+        _mm256_storeu_ps(p, positionLow);
+        _mm256_storeu_ps(p + 8, positionHigh);
+    }
+    IntegratePositionsSse2(position + i, velocity + i, flags + i, skip, count - i, dt);
+}
+
+// The OS has to save the YMM registers on a context switch as well, which cpuid alone does not say
+static bool CpuSupportsAvx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+static const BodyKernels ScalarKernels = { AddGravityScalar, ApplyForcesScalar, IntegratePositionsScalar };
+#ifdef KERNELS_X86
+static const BodyKernels Sse2Kernels = { AddGravitySse2, ApplyForcesSse2, IntegratePositionsSse2 };
+static const BodyKernels Avx2Kernels = { AddGravityAvx2, ApplyForcesAvx2, IntegratePositionsAvx2 };
+#endif
+
+KernelLevel DetectKernelLevel()
+{
+#ifdef KERNELS_X86
+    // SSE2 is part of x86-64
+    static const KernelLevel detected = CpuSupportsAvx2() ? KERNEL_AVX2 : KERNEL_SSE2;
+    return detected;
+#else
+    return KERNEL_SCALAR;
+#endif
+}
+
+bool IsKernelLevelSupported(KernelLevel level)
+{
+    return level >= KERNEL_SCALAR && level <= DetectKernelLevel();
+}
+
+const char* KernelLevelName(KernelLevel level)
+{
+    switch (level)
+    {
+    case KERNEL_SCALAR: return "scalar";
+    case KERNEL_SSE2: return "sse2";
+    case KERNEL_AVX2: return "avx2";
+    default: return "unknown";
+    }
+}
+
+const BodyKernels& GetBodyKernels(KernelLevel level)
+{
+    if (level > DetectKernelLevel()) level = DetectKernelLevel();
+#ifdef KERNELS_X86
+    if (level == KERNEL_AVX2) return Avx2Kernels;
+    if (level == KERNEL_SSE2) return Sse2Kernels;
+#endif
+    return ScalarKernels;
+}
+
+// The test is written as "not farther than" so a NaN distance counts as touching, exactly as in
+// CircleCircleContact. Misses are written too and only hits advance, so there is no branch.
+int OverlappingPairs(const CandidatePair* pairs, int count, const Vector2* position, const float* radius, int* overlapping)
+{
+    int found = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int a = pairs[i].a;
+        int b = pairs[i].b;
+        Vector2 displacement = position[b] - position[a];
+        float sumOfRadius = radius[a] + radius[b];
+        overlapping[found] = i;
+        found += !(Vector2LengthSqr(displacement) > sumOfRadius * sumOfRadius);
+    }
+    return found;
+}
@@ -8,14 +8,14 @@ See documentation here: https://www.raylib.com/, and examples here: https://www.
 #define RAYGUI_IMPLEMENTATION
 #include "raygui.h"
 #include "game.h"
-#include <string>
-#include <vector>
+#include "physics.h"
+#include "physicsthread.h"
+#include "circlerenderer.h"
+#include "profiler.h"
 
 const unsigned int TARGET_FPS = 50;
-float dt = 60;
-float time = 0;
+float renderRate = TARGET_FPS;
 
-float coefficientOfFriction = 0.5f;
 float worldmass = 1.0f;
 float restitution = 0.9f;
 
@@ -24,377 +24,323 @@ float y = 500;
 float frequency = 1;
 float amplitude = 100;
 
-enum PhysicsShape
-{
-    CIRCLE,
-    HALFSPACE
-};
+float speed = 100;
+float angle = 0;
+float launchPosition = 100;
+int broadPhaseSelection = SPATIAL_HASH;
 
-class PhysicsObject
-{
-public:
-    bool isStatic = false;
-    Vector2 position = {0 , 0 };
-    Vector2 velocity = { 0, 0 };
-    float mass = 1;
-    Vector2 netForce = { 0,0 };
-    float bounciness = 0.8f;
-
-    std::string name = "object";
-    Color color = GREEN;
-    virtual void draw()
-    {
-        DrawCircle(position.x, position.y, 2, color);
-        //DrawText(name.c_str(), position.x, position.y, 12, LIGHTGRAY);
-        // DrawLineEx(position, (position + velocity), 1, RED);
-    }
-    virtual PhysicsShape Shape() = 0;
-};
+PhysicsWorld world;
+// Steps the world at its own rate once started, from then on the GUI only reads its snapshots and
+// sends it commands
+PhysicsThread physicsThread(world);
+// What the sliders edit, sent to the physics thread whenever it differs from what was last sent
+PhysicsSettings settings;
+PhysicsSettings sentSettings;
+PhysicsHalfspace halfspace;
+PhysicsHalfspace halfspace2;
+PhysicsHalfspace halfspace3;
 
-class PhysicsHalfspace : public PhysicsObject
+// Instanced drawing only shows the discs, the immediate path also labels them and draws velocity
+CircleRenderer circleRenderer;
+bool instancedCircles = true;
+bool bulletBirds = false;
+// Bodies are drawn between their last two physics states at the wall clock's fraction of the step,
+// so a low physics rate still moves smoothly. Off draws the latest state as it is.
+bool interpolation = true;
+std::vector<Vector2> drawPositions;
+bool showProfiler = false;
+// F2 writes this many frames of every thread's zones to a Chrome trace
+int traceFrames = 120;
+const char* tracePath = "trace.json";
+std::vector<ProfileThreadStats> profileStats;
+
+void DrawHalfspace(const RenderSnapshot::Halfspace& halfspace)
 {
-private:
-    float rotation = 0;
-    Vector2 normal = { 0,-1 };
-public:
-    void setRotationDegrees(float rotationInDegrees)
-    {
-        rotation = rotationInDegrees;
-        normal = Vector2Rotate({ 0,-1 },rotation * DEG2RAD);
-    }
-    float getRotation()
-    {
-        return rotation;
-    }
-    Vector2 getNormal()
-    {
-        return normal;
-    }
-    void draw() override
-    {
-        DrawCircle(position.x, position.y, 8, color);
-        DrawLineEx(position, position + normal * 30, 1, color);
-        Vector2 parallelToSurface = Vector2Rotate(normal, PI * 0.5f);
-        DrawLineEx(position - parallelToSurface * 4000,position + parallelToSurface * 4000, 1, color);
+    Vector2 position = halfspace.position;
+    Vector2 normal = halfspace.normal;
+    DrawCircle(position.x, position.y, 8, halfspace.color);
+    DrawLineEx(position, position + normal * 30, 1, halfspace.color);
+    Vector2 parallelToSurface = Vector2Rotate(normal, PI * 0.5f);
+    DrawLineEx(position - parallelToSurface * 4000,position + parallelToSurface * 4000, 1, halfspace.color);
+}
 
-    }
+void DrawCircleBody(const RenderSnapshot& snapshot, int index, Vector2 position)
+{
+    float radius = snapshot.radius[index];
+    Color color = snapshot.color[index];
+    DrawCircle(position.x, position.y, radius, color);
+    DrawText(TextFormat("%u", snapshot.serial[index]), position.x, position.y, radius * 2, LIGHTGRAY);
+    DrawLineEx(position, (position + snapshot.velocity[index]), 1, color);
+}
 
-    PhysicsShape Shape() override
+// Index of the circle drawn under a point, or -1. The world's tree belongs to the physics thread,
+// so this is a plain scan of the snapshot.
+int PickCircle(const RenderSnapshot& snapshot, const std::vector<Vector2>& positions, Vector2 point)
+{
+    for (int i = 0; i < snapshot.size(); i++)
     {
-        return HALFSPACE;
+        float radius = snapshot.radius[i];
+        if (Vector2DistanceSqr(positions[i], point) <= radius * radius) return i;
     }
-};
+    return -1;
+}
 
-class PhysicsCircle : public PhysicsObject
+// Replays what the last physics step recorded, skipping categories switched off in the GUI since
+void DrawDebugOverlay(const DebugDraw& debugDraw, const bool enabled[DEBUG_DRAW_CATEGORY_COUNT])
 {
-public:
-    float radius;
-
-    void draw() override
+    PROFILE_ZONE("DrawDebugOverlay");
+    for (int i = 0; i < debugDraw.lines.size(); i++)
     {
-        DrawCircle(position.x, position.y, radius, color);
-        DrawText(name.c_str(), position.x, position.y, radius * 2, LIGHTGRAY);
-        DrawLineEx(position, (position + velocity), 1, color);
+        const DebugDraw::Line& line = debugDraw.lines[i];
+        if (!enabled[line.category]) continue;
+
+        DrawLineEx(line.from, line.to, line.thickness, line.color);
+        if (line.arrow)
+        {
+            Vector2 direction = line.to - line.from;
+            float length = Vector2Length(direction);
+            if (length < 0.0001f) continue;
+            Vector2 back = direction * (-fminf(8.0f, length * 0.5f) / length);
+            DrawLineEx(line.to, line.to + Vector2Rotate(back, 30 * DEG2RAD), line.thickness, line.color);
+            DrawLineEx(line.to, line.to + Vector2Rotate(back, -30 * DEG2RAD), line.thickness, line.color);
+        }
     }
 
-    PhysicsShape Shape() override
+    for (int i = 0; i < debugDraw.texts.size(); i++)
     {
-        return CIRCLE;
+        const DebugDraw::Text& text = debugDraw.texts[i];
+        if (!enabled[text.category]) continue;
+        DrawText(text.text, text.position.x, text.position.y, text.fontSize, text.color);
     }
-};
-
-
-
-bool CircleCircleCollision(PhysicsCircle* circleA, PhysicsCircle* circleB);
-bool CircleHalfspaceCollision(PhysicsCircle* circle, PhysicsHalfspace* halfspace);
+}
 
-class PhysicsWorld
+// Rolling mean and max of every zone per thread, above a graph of its last frames. The dashed line
+// is the thread's budget, a frame at the render rate or a step at the physics rate.
+void DrawProfilerOverlay()
 {
-private:
-    unsigned int objectCount = 0;
-public:
-    std::vector<PhysicsObject*> objects;
-    Vector2 accelerationGravity = { 0,9 };
+    PROFILE_ZONE("DrawProfilerOverlay");
+    ProfilerGetStats(profileStats);
 
-    void add(PhysicsObject* newObject)
+    int rows = 0;
+    for (int i = 0; i < profileStats.size(); i++)
     {
-        newObject->name = std::to_string(objectCount);
-        objects.push_back(newObject);
-        objectCount++;
+        rows += 1 + (int)profileStats[i].zones.size();
     }
-
-    void ResetNetForce()
+    const float width = 420;
+    const float graphHeight = 60;
+    float height = 30 + rows * 16 + profileStats.size() * (graphHeight + 10);
+    Rectangle bounds = { GetScreenWidth() - width - 10, 500, width, height };
+    GuiPanel(bounds, PROFILER_ENABLED ? "Profiler  (mean / max ms)" : "Profiler compiled out");
+
+    float y = bounds.y + 30;
+    for (int i = 0; i < profileStats.size(); i++)
     {
-        for (int i = 0; i < objects.size(); i++)
+        const ProfileThreadStats& thread = profileStats[i];
+        DrawText(TextFormat("%s frame  %.2f / %.2f", thread.name.c_str(), thread.meanFrameMs, thread.maxFrameMs), bounds.x + 8, y, 10, YELLOW);
+        y += 16;
+        for (int j = 0; j < thread.zones.size(); j++)
         {
-            objects[i]->netForce = { 0,0 };
+            const ProfileZoneStats& zone = thread.zones[j];
+            DrawText(zone.name, bounds.x + 16 + zone.depth * 12, y, 10, DARKGRAY);
+            DrawText(TextFormat("%.3f / %.3f", zone.meanMs, zone.maxMs), bounds.x + width - 130, y, 10, DARKGRAY);
+            y += 16;
         }
-    }
 
-    void AddGravityForce()
-    {
-        for (int i = 0; i < objects.size(); i++)
+        // One bar per frame, scaled so the slowest frame in view fits
+        Rectangle graph = { bounds.x + 8, y, width - 16, graphHeight };
+        DrawRectangleLinesEx(graph, 1, LIGHTGRAY);
+        float budget = 1000.0f / (thread.name == "Render" ? renderRate : settings.physicsRate);
+        float scale = fmaxf((float)thread.maxFrameMs, budget);
+        float barWidth = graph.width / PROFILER_HISTORY;
+        for (int j = 0; j < thread.frameMs.size(); j++)
         {
-            PhysicsObject* object = objects[i];
-
-            if (object->isStatic) continue;
-
-            Vector2 FGravity = accelerationGravity * object->mass;
-            object->netForce += FGravity;
-
-            DrawLineEx(object->position, object->position + FGravity, 1, PURPLE);
+            float barHeight = graph.height * thread.frameMs[j] / scale;
+            DrawRectangleRec({ graph.x + j * barWidth, graph.y + graph.height - barHeight, fmaxf(barWidth - 1, 1), barHeight }, thread.frameMs[j] > budget ? RED : GREEN);
         }
-    }
-
-    void ApplyKinematics()
-    {
-        for (int i = 0; i < objects.size(); i++)
+        float budgetY = graph.y + graph.height - graph.height * budget / scale;
+        for (float x = graph.x; x < graph.x + graph.width; x += 8)
         {
-            PhysicsObject* object = objects[i];
+            DrawLineEx({ x, budgetY }, { fminf(x + 4, graph.x + graph.width), budgetY }, 1, ORANGE);
+        }
+        y += graphHeight + 10;
+    }
+}
 
-            if (object->isStatic) continue;
+//Vector2 position = {500, 500};
+//Vector2 velocity = { 0, 0 };
 
-            object->position = object->position + object->velocity * dt;
-            Vector2 acceleration = object->netForce / object->mass;
-            object->velocity = object->velocity + acceleration * dt;
 
-            DrawLineEx(object->position, object->position + object->netForce, 4, GRAY);
-        }
+void update()
+{
+    PROFILE_ZONE("update");
+    if (IsKeyPressed(KEY_F1)) showProfiler = !showProfiler;
+    if (IsKeyPressed(KEY_F2)) ProfilerStartCapture(traceFrames, tracePath);
+    // Birds that leave the area around the screen are despawned so the world does not grow forever
+    settings.keepArea = { -(float)GetScreenWidth(), -(float)GetScreenHeight(), 3.0f * GetScreenWidth(), 3.0f * GetScreenHeight() };
+    // Sent again next frame if the queue was full
+    if (settings != sentSettings)
+    {
+        PhysicsCommand command;
+        command.type = COMMAND_SETTINGS;
+        command.settings = settings;
+        if (physicsThread.send(command)) sentSettings = settings;
     }
 
-    void update()
+    //position += velocity * dt;
+    //velocity += accelerationGravity * dt;
+    if (IsKeyPressed(KEY_SPACE))
     {
-        ResetNetForce();
-        AddGravityForce();
-        checkCollisions();
-        ApplyKinematics();
+        PhysicsCommand command;
+        command.type = COMMAND_SPAWN_CIRCLE;
+        command.position = { 100, (float)GetScreenHeight() - launchPosition };
+        command.velocity = { speed * (float)cos(angle * DEG2RAD), speed * (float)sin(angle * DEG2RAD) };
+        command.radius = 15;
+        command.mass = worldmass;
+        command.bounciness = restitution;
+        command.bullet = bulletBirds;
+        physicsThread.send(command);
     }
+}
 
-    void checkCollisions()
+// The sliders, toggles and HUD text. Edits go to the settings, which update() sends on.
+void drawGui(const RenderSnapshot& snapshot, float alpha)
+{
+    PROFILE_ZONE("GUI");
+    DrawText("Johnny Zimmer: 101533005 - GAME2005", 10, 10, 20, DARKGRAY);
+    GuiSliderBar(Rectangle{ 10, 40, 500, 30 }, "", TextFormat("Speed:%.0f", speed), &speed, -1000, 1000);
+    GuiSliderBar(Rectangle{ 10, 80, 500, 30 }, "", TextFormat("Angle:%.0f Degrees", angle), &angle, -180, 180);
+    GuiSliderBar(Rectangle{ 10, 120, 500, 30 }, "", TextFormat("Launch Position Height:%.0f ", launchPosition), &launchPosition, 100, 600);
+    
+    GuiSliderBar(Rectangle{ 10, 160, 500, 30 }, "", TextFormat("Gravity: %.0f Px/sec^2 ", settings.gravity.y), &settings.gravity.y, -1000, 1000);
+
+    GuiSliderBar(Rectangle{ 10, 200, 300, 30 }, "", TextFormat("Halfspace X: %0.f",settings.halfspacePosition.x), &settings.halfspacePosition.x, 0, GetScreenHeight());
+    GuiSliderBar(Rectangle{ 410, 200, 300, 30 }, "", TextFormat("HalfSpace Y: %0.f",settings.halfspacePosition.y), &settings.halfspacePosition.y, 0, GetScreenHeight());
+    GuiSliderBar(Rectangle{ 810, 200, 300, 30 }, "", TextFormat("Rotation: %0.f", settings.halfspaceRotation), &settings.halfspaceRotation, -360, 360);
+    GuiSliderBar(Rectangle{ 10, 240, 300, 30 }, "", TextFormat("Friction: %0.2f", settings.friction), &settings.friction, 0, 1);
+    GuiSliderBar(Rectangle{ 410, 240, 300, 30 }, "", TextFormat("World Mass: %0.2f", worldmass), &worldmass, 0, 10);
+    GuiSliderBar(Rectangle{ 810, 240, 300, 30 }, "", TextFormat("Resitution: %0.2f", restitution), &restitution, 0, 1);
+
+    GuiToggleGroup(Rectangle{ 10, 280, 95, 30 }, "Brute Force;Spatial Hash;Sweep & Prune;AABB Tree", &broadPhaseSelection);
+    GuiSliderBar(Rectangle{ 410, 280, 300, 30 }, "", TextFormat("Cell Size: %0.f", settings.cellSize), &settings.cellSize, 8, 256);
+    DrawText(TextFormat("Bodies: %d  Pairs Tested: %d", snapshot.size(), snapshot.pairsTested), 810, 285, 20, LIGHTGRAY);
+    if (settings.broadPhase == SWEEP_AND_PRUNE)
     {
-        for (int i = 0; i < objects.size(); i++)
-        {
-            objects[i]->color = GREEN;
-        }
-
-        for (int i = 0; i < objects.size();i++)
-        {
-            for (int j = i + 1 ; j < objects.size();j++)
-            {
-                if (i == j) continue;
-                PhysicsObject* objectPointerA = objects[i];
-                PhysicsObject* objectPointerB = objects[j];
-                //PhysicsCircle* circlePointerA = (PhysicsCircle*)objectPointerA;
-                //PhysicsCircle* circlePointerB = (PhysicsCircle*)objectPointerB;
-                PhysicsShape shapeOfA = objectPointerA->Shape();
-                PhysicsShape shapeOfB = objectPointerB->Shape();
-
-                bool didOverlap = false;
-
-                if (shapeOfA == CIRCLE && shapeOfB == CIRCLE)
-                {
-                    didOverlap = CircleCircleCollision((PhysicsCircle*)objectPointerA, (PhysicsCircle*)objectPointerB);
-                    
-                }
-                else if (shapeOfA == CIRCLE && shapeOfB == HALFSPACE)
-                {
-                    didOverlap = CircleHalfspaceCollision((PhysicsCircle*)objectPointerA, (PhysicsHalfspace*)objectPointerB);
-                }
-                else if (shapeOfA == HALFSPACE && shapeOfB == CIRCLE)
-                {
-                    didOverlap = CircleHalfspaceCollision((PhysicsCircle*)objectPointerB, (PhysicsHalfspace*)objectPointerA);
-
-                }
-
-                if(didOverlap)
-                {
-                    objectPointerA->color = RED;
-                    objectPointerB->color = RED;
-                }
-                
-  
-            }
-
-        }
+        DrawText(TextFormat("Pairs Begun: %d  Ended: %d", snapshot.pairsBegun, snapshot.pairsEnded), 810, 310, 20, LIGHTGRAY);
+    }
+    else if (settings.broadPhase == AABB_TREE)
+    {
+        DrawText(TextFormat("Tree Height: %d  Nodes: %d  Area Ratio: %.1f", snapshot.treeHeight, snapshot.treeNodes, snapshot.treeAreaRatio), 810, 310, 20, LIGHTGRAY);
     }
-};
-
-
-
-float speed = 100;
-float angle = 0;
-float launchPosition = 100;
 
-PhysicsWorld world;
-PhysicsHalfspace halfspace;
-PhysicsHalfspace halfspace2;
-PhysicsHalfspace halfspace3;
+    int hovered = PickCircle(snapshot, drawPositions, GetMousePosition());
+    if (hovered != -1)
+    {
+        DrawText(TextFormat("Body %u  Speed: %.0f", snapshot.serial[hovered], Vector2Length(snapshot.velocity[hovered])), GetMouseX() + 15, GetMouseY(), 20, YELLOW);
+    }
+    settings.broadPhase = (BroadPhase)broadPhaseSelection;
 
-bool CircleCircleOverlap(PhysicsCircle* circleA, PhysicsCircle* circleB)
-{
-    Vector2 displacementFromAToB = circleB->position - circleA->position;
-    float distance = Vector2Length(displacementFromAToB);
-    float sumOfRadius = circleA->radius + circleB->radius;
+    GuiSliderBar(Rectangle{ 10, 320, 300, 30 }, "", TextFormat("Physics Rate: %.0f Hz", settings.physicsRate), &settings.physicsRate, 10, 240);
+    float previousRenderRate = renderRate;
+    GuiSliderBar(Rectangle{ 410, 320, 300, 30 }, "", TextFormat("Render Rate: %.0f FPS", renderRate), &renderRate, 10, 240);
+    if ((int)renderRate != (int)previousRenderRate) SetTargetFPS((int)renderRate);
+    DrawText(TextFormat("Steps/s: %.0f  FPS: %d", snapshot.stepsPerSecond, GetFPS()), 810, 335, 20, LIGHTGRAY);
 
-    if (sumOfRadius > distance)
+    for (int i = 0; i < DEBUG_DRAW_CATEGORY_COUNT; i++)
     {
-        return true;
+        GuiCheckBox(Rectangle{ 10.0f + i * 150, 365, 20, 20 }, DebugDrawCategoryName((DebugDrawCategory)i), &settings.debugDraw[i]);
     }
-    else
-        return false;
-}
-
-bool CircleCircleCollision(PhysicsCircle* circleA, PhysicsCircle* circleB)
-{
-    Vector2 displacementFromAToB = circleB->position - circleA->position;
-    float distance = Vector2Length(displacementFromAToB);
-    float sumOfRadius = circleA->radius + circleB->radius;
-    float overlap = sumOfRadius - distance;
-    if (overlap >= 0)
+    if (circleRenderer.isLoaded())
     {
-        Vector2 normal = displacementFromAToB / distance;
-        Vector2 mtv = normal * overlap;
-        circleA->position -= mtv * 0.5f;
-        circleB->position += mtv * 0.5f;
-
-        Vector2 velocityBRelativeToA = circleB->velocity - circleA->velocity;
-        float closingVelocity = Vector2DotProduct(velocityBRelativeToA, normal);
-        if (closingVelocity >= 0)  return true;
-        
-        float restitution = circleA->bounciness * circleB->bounciness;
-        float totalMass = circleA->mass + circleB->mass;
-        float impulseMagnitude = ((1.0f + restitution)*closingVelocity*circleA->mass*circleB->mass) / totalMass;
-        Vector2 impulseB = normal * -impulseMagnitude;
-        Vector2 impulseA = normal * impulseMagnitude;
-
-        circleA->velocity += impulseA / circleA->mass;
-        circleB->velocity += impulseB / circleB->mass;
-        return true;
+        GuiCheckBox(Rectangle{ 610, 365, 20, 20 }, "Instanced Circles", &instancedCircles);
     }
-    else
-        return false;
-}
 
-bool CircleHalfspaceOverlap(PhysicsCircle* circle, PhysicsHalfspace* halfspace)
-{
-    Vector2 displacementToCircle = circle->position - halfspace->position;
-    float dot = Vector2DotProduct(displacementToCircle, halfspace->getNormal());
-    Vector2 vectorProjection = halfspace->getNormal() * dot;
+    float threadCount = (float)settings.threads;
+    float maxThreads = fmaxf(1, (float)std::thread::hardware_concurrency());
+    GuiSliderBar(Rectangle{ 810, 365, 300, 20 }, "", TextFormat("Threads: %d", settings.threads), &threadCount, 1, maxThreads);
+    settings.threads = (int)threadCount;
+
+    float solverIterations = (float)settings.solverIterations;
+    GuiSliderBar(Rectangle{ 10, 395, 300, 20 }, "", TextFormat("Solver Iterations: %d", settings.solverIterations), &solverIterations, 1, 32);
+    settings.solverIterations = (int)solverIterations;
+    GuiCheckBox(Rectangle{ 410, 395, 20, 20 }, "Warm Starting", &settings.warmStarting);
+    GuiCheckBox(Rectangle{ 610, 395, 20, 20 }, "Sleeping", &settings.sleeping);
+    DrawText(TextFormat("Contacts: %d  Warm Started: %d", snapshot.contacts, snapshot.warmStarted), 810, 395, 20, LIGHTGRAY);
+    DrawText(TextFormat("Colors: %d  Largest Batch: %d  Overflow: %d", snapshot.colors, snapshot.largestBatch, snapshot.overflow), 810, 420, 20, LIGHTGRAY);
+    DrawText(TextFormat("Awake: %d  Asleep: %d", snapshot.awake, snapshot.asleep), 810, 445, 20, LIGHTGRAY);
+    GuiCheckBox(Rectangle{ 10, 425, 20, 20 }, "Continuous Collision", &settings.continuousCollision);
+    GuiCheckBox(Rectangle{ 210, 425, 20, 20 }, "Bullet Birds", &bulletBirds);
+    DrawText(TextFormat("Swept: %d  Impacts: %d", snapshot.swept, snapshot.impacts), 410, 425, 20, LIGHTGRAY);
+    GuiCheckBox(Rectangle{ 10, 450, 20, 20 }, "Interpolation", &interpolation);
+    GuiCheckBox(Rectangle{ 210, 450, 20, 20 }, "Profiler (F1)", &showProfiler);
+    DrawText(TextFormat("Alpha: %.2f", alpha), 410, 450, 20, LIGHTGRAY);
+    if (ProfilerCapturing())
+        DrawText(TextFormat("Tracing %d frames", traceFrames), 560, 450, 20, ORANGE);
+    else
+        DrawText(TextFormat("F2 Trace: %d written", ProfilerTracesWritten()), 560, 450, 20, LIGHTGRAY);
 
-    bool isOverlapping = dot <= circle->radius && dot >= -circle->radius;
-    DrawLineEx(circle->position, circle->position - vectorProjection, 1, GRAY);
-    Vector2 midpoint = circle->position - vectorProjection * 0.5f;
-    DrawText(TextFormat("D: %6.0f", dot), midpoint.x, midpoint.y, 30, GRAY);
+    float substeps = (float)settings.substeps;
+    GuiSliderBar(Rectangle{ 10, 475, 300, 20 }, "", TextFormat("Substeps: %d", settings.substeps), &substeps, 1, 16);
+    settings.substeps = (int)substeps;
+    DrawText(TextFormat("Once Per Step: %.3f ms  Per Substep: %.3f ms", snapshot.msPerStep, snapshot.msPerSubstep), 410, 475, 20, LIGHTGRAY);
 
-    return isOverlapping;
+    const StepStats& stats = snapshot.stats;
+    DrawText(TextFormat("Candidate Pairs: %d  Narrow Tests: %d  Contacts: %d  Efficiency: %.1f%%", stats.candidatePairs, stats.narrowTests, stats.contacts, stats.efficiency() * 100), 10, 505, 20, LIGHTGRAY);
+    DrawText(TextFormat("Halfspace Contacts: %d  Iterations: %d  Integrated: %d  Allocations: %lld", stats.halfspaceContacts, stats.solverIterations, stats.bodiesIntegrated, stats.allocations), 10, 530, 20, LIGHTGRAY);
 }
 
-bool CircleHalfspaceCollision(PhysicsCircle* circle, PhysicsHalfspace* halfspace)
+void drawBodies(const RenderSnapshot& snapshot)
 {
-    Vector2 displacementToCircle = circle->position - halfspace->position;
-    float dot = Vector2DotProduct(displacementToCircle, halfspace->getNormal());
-    Vector2 vectorProjection = halfspace->getNormal() * dot;
-    float overlap = circle->radius - dot;
-    if (overlap > 0)
+    PROFILE_ZONE("drawBodies");
+    if (instancedCircles && circleRenderer.isLoaded())
     {
-        Vector2 mtv = halfspace->getNormal() * overlap;
-        circle->position += mtv;
-
-        Vector2 Fgravity = world.accelerationGravity * circle->mass;
-        Vector2 FgPerp = halfspace->getNormal() * Vector2DotProduct(Fgravity, halfspace->getNormal());
-        Vector2 Fnormal = FgPerp * -1;
-        circle->netForce += Fnormal;
-        DrawLineEx(circle->position, circle->position + Fnormal, 2, GREEN);
-        //Friction
-        Vector2 normalVelocity = halfspace->getNormal() * Vector2DotProduct(circle->velocity, halfspace->getNormal());
-        Vector2 frictionVelocity = circle->velocity - normalVelocity;
-        float frictionSpeed = Vector2Length(frictionVelocity);
-        if (frictionSpeed > 0.0001f)
+        circleRenderer.clear();
+        for (int i = 0; i < snapshot.size(); i++)
         {
-            Vector2 frictionDirection = Vector2Normalize(frictionVelocity) * -1;
-            float frictionMagnitude = coefficientOfFriction * Vector2Length(Fnormal);
-            Vector2 Ffriction = frictionDirection * frictionMagnitude;
-            circle->netForce += Ffriction;
-            DrawLineEx(circle->position, circle->position + Ffriction, 2, ORANGE);
+            circleRenderer.add(drawPositions[i], snapshot.radius[i], snapshot.color[i]);
         }
-        //Bouncing
-        //Vector2 velocityBRelativeToA = circleB->velocity - circleA->velocity;
-        float closingVelocity = Vector2DotProduct(circle->velocity, halfspace->getNormal());
-        if (closingVelocity >= 0)  return true;
-
-        float restitution = circle->bounciness * halfspace->bounciness;
-        circle->velocity += halfspace->getNormal() * closingVelocity * -(1.0f + restitution);
-
-
-        return true;
+        circleRenderer.draw();
     }
     else
     {
-        return false;
+        for (int i = 0;i < snapshot.size();i++)
+        {
+            DrawCircleBody(snapshot, i, drawPositions[i]);
+        }
     }
-    /*bool isOverlapping = dot <= circle->radius && dot >= -circle->radius;*/
-    /*DrawLineEx(circle->position, circle->position - vectorProjection, 1, GRAY);
-    Vector2 midpoint = circle->position - vectorProjection * 0.5f;
-    DrawText(TextFormat("D: %6.0f", dot), midpoint.x, midpoint.y, 30, GRAY);*/
 }
 
-//Vector2 position = {500, 500};
-//Vector2 velocity = { 0, 0 };
-
-
-void update()
-{
-    dt = 1.0f / TARGET_FPS;
-    time += dt;
-
-    world.update();
-    //position += velocity * dt;
-    //velocity += accelerationGravity * dt;
-    if (IsKeyPressed(KEY_SPACE))
-    {
-        PhysicsCircle* newBird = new PhysicsCircle();
-        newBird->position = { 100, (float)GetScreenHeight() - launchPosition };
-        newBird->velocity = { speed * (float)cos(angle * DEG2RAD), speed * (float)sin(angle * DEG2RAD) };
-        newBird->radius = 15;
-        newBird->mass = worldmass;
-        newBird->bounciness = restitution;
-        world.add(newBird);
-    }
-}   
-
 void draw()
 {
+    PROFILE_ZONE("draw");
         
         BeginDrawing();
             ClearBackground(BLACK);
-            DrawText("Johnny Zimmer: 101533005 - GAME2005", 10, 10, 20, DARKGRAY);
-            GuiSliderBar(Rectangle{ 10, 40, 500, 30 }, "", TextFormat("Speed:%.0f", speed), &speed, -1000, 1000);
-            GuiSliderBar(Rectangle{ 10, 80, 500, 30 }, "", TextFormat("Angle:%.0f Degrees", angle), &angle, -180, 180);
-            GuiSliderBar(Rectangle{ 10, 120, 500, 30 }, "", TextFormat("Launch Position Height:%.0f ", launchPosition), &launchPosition, 100, 600);
-            
-            GuiSliderBar(Rectangle{ 10, 160, 500, 30 }, "", TextFormat("Gravity: %.0f Px/sec^2 ", world.accelerationGravity.y), &world.accelerationGravity.y, -1000, 1000);
-
-            GuiSliderBar(Rectangle{ 10, 200, 300, 30 }, "", TextFormat("Halfspace X: %0.f",halfspace.position.x), &halfspace.position.x, 0, GetScreenHeight());
-            GuiSliderBar(Rectangle{ 410, 200, 300, 30 }, "", TextFormat("HalfSpace Y: %0.f",halfspace.position.y), &halfspace.position.y, 0, GetScreenHeight());
-            float halfspaceRotation = halfspace.getRotation();
-            GuiSliderBar(Rectangle{ 810, 200, 300, 30 }, "", TextFormat("Rotation: %0.f", halfspace.getRotation()), &halfspaceRotation, -360, 360);
-            GuiSliderBar(Rectangle{ 10, 240, 300, 30 }, "", TextFormat("Friction: %0.2f", coefficientOfFriction), &coefficientOfFriction, 0, 1);
-            GuiSliderBar(Rectangle{ 410, 240, 300, 30 }, "", TextFormat("World Mass: %0.2f", worldmass), &worldmass, 0, 10);
-            GuiSliderBar(Rectangle{ 810, 240, 300, 30 }, "", TextFormat("Resitution: %0.2f", restitution), &restitution, 0, 1);
 
+            // Drawn from the newest finished step, which cannot change until the next frame asks
+            const RenderSnapshot& snapshot = physicsThread.latestSnapshot();
+            float alpha = interpolation ? snapshot.interpolationAlpha() : 1.0f;
+            drawPositions.resize(snapshot.size());
+            for (int i = 0; i < snapshot.size(); i++)
+            {
+                drawPositions[i] = Vector2Lerp(snapshot.previousPosition[i], snapshot.position[i], alpha);
+            }
 
+            drawGui(snapshot, alpha);
 
-            halfspace.setRotationDegrees(halfspaceRotation);
-            
             Vector2 startPos = { 100, GetScreenHeight() - launchPosition};
             Vector2 velocity = { speed * cos(angle* DEG2RAD), speed * sin(angle* DEG2RAD)};
 
             DrawLineEx(startPos, (startPos + velocity), 3, RED);
 
-            for (int i = 0;i < world.objects.size();i++)
+            for (int i = 0; i < snapshot.halfspaces.size(); i++)
             {
-                world.objects[i]->draw();
+                DrawHalfspace(snapshot.halfspaces[i]);
             }
+            drawBodies(snapshot);
+            // The categories switched on here hide and show right away, the physics thread records
+            // newly enabled ones from its next step on
+            DrawDebugOverlay(snapshot.debugDraw, settings.debugDraw);
+            if (showProfiler) DrawProfilerOverlay();
         
             //DrawCircle(position.x, position.y, 15, RED);
             
@@ -415,7 +361,11 @@ void draw()
             DrawLine(location.x, location.y, location.x + FgFriction.x, location.y + FgFriction.y, ORANGE);*/
 
 
-        EndDrawing();
+        {
+            // Includes the wait for the target frame rate
+            PROFILE_ZONE("EndDrawing");
+            EndDrawing();
+        }
 
 }
 
@@ -423,10 +373,15 @@ int main()
 {
     InitWindow(InitialWidth, InitialHeight, "Johnny Zimmer: 101533005 - GAME2005");
     SetTargetFPS(TARGET_FPS);
+    circleRenderer.load();
+    world.jobs.setThreadCount((int)std::thread::hardware_concurrency());
+    world.reserve(10000);
     halfspace.isStatic = true;
     halfspace.position = { 500 ,600 };
     world.add(&halfspace);
     halfspace2.setRotationDegrees(-45);
+    settings = CaptureSettings(world);
+    sentSettings = settings;
 
     /*halfspace2.isStatic = true;
     halfspace2.position = { 500,800 };
@@ -438,12 +393,17 @@ int main()
     
     world.add(&halfspace2);
     world.add(&halfspace3);*/
+    physicsThread.start();
     while (!WindowShouldClose())
     {
         update();
         draw();
+        ProfilerFlush("Render");
     }
+    physicsThread.stop();
+    ProfilerFinishWrites();
 
+    circleRenderer.unload();
     CloseWindow();
     return 0;
 }
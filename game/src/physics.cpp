@@ -0,0 +1,1014 @@
+#include "physics.h"
+#include "profiler.h"
+#include "allocationcounter.h"
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <cfloat>
+
+using Clock = std::chrono::steady_clock;
+
+// Bodies per job range in the per-body stages, enough to amortize a steal
+static const int BODY_GRAIN = 1024;
+static const int PAIR_GRAIN = 2048;
+// Rows of the all-pairs triangle per job range, the rows near the top are the long ones
+static const int ROW_GRAIN = 16;
+
+// Bodies that neither sleep nor are static, the ones the stages have to work on
+static const unsigned char BODY_INACTIVE = BODY_STATIC | BODY_SLEEPING;
+
+static bool IsAwake(unsigned char flags)
+{
+    return !(flags & BODY_INACTIVE);
+}
+
+// Stable counting sort on key(contact), which must be in [0, range). Two passes, least significant
+// key first, give the full order in linear time.
+template <typename Key>
+static void CountingSort(std::vector<Contact>& contacts, std::vector<Contact>& scratch, std::vector<int>& offsets, int range, Key key)
+{
+    offsets.assign(range + 1, 0);
+    for (int i = 0; i < contacts.size(); i++)
+    {
+        offsets[key(contacts[i]) + 1]++;
+    }
+    for (int i = 0; i < range; i++)
+    {
+        offsets[i + 1] += offsets[i];
+    }
+
+    scratch.resize(contacts.size());
+    for (int i = 0; i < contacts.size(); i++)
+    {
+        scratch[offsets[key(contacts[i])]++] = contacts[i];
+    }
+    contacts.swap(scratch);
+}
+
+// Seconds since mark, moving mark to now so consecutive stages can be timed back to back
+static double Lap(Clock::time_point& mark)
+{
+    Clock::time_point now = Clock::now();
+    double seconds = std::chrono::duration<double>(now - mark).count();
+    mark = now;
+    return seconds;
+}
+
+void PhysicsWorld::add(PhysicsHalfspace* newHalfspace)
+{
+    newHalfspace->name = std::to_string(objectCount);
+    halfspaces.push_back(newHalfspace);
+    objectCount++;
+}
+
+PhysicsCircle PhysicsWorld::addCircle(Vector2 position, Vector2 velocity, float radius, float mass, float bounciness)
+{
+    PhysicsCircle circle;
+    circle.bodies = &bodies;
+    circle.handle = bodies.add(position, velocity, radius, mass, bounciness, objectCount);
+    objectCount++;
+    if (mass <= 0) restingChanged = true;
+    return circle;
+}
+
+bool PhysicsWorld::removeCircle(BodyHandle handle)
+{
+    int index = bodies.indexOf(handle);
+    if (index == -1) return false;
+
+    // What was resting on it has to notice it is gone
+    if (bodies.flags[index] & BODY_SLEEPING) wakeIsland(bodies.island[index]);
+    // The grid's resting layer holds indices, and the removal moves the last body into this one
+    restingChanged = true;
+
+    int slot = handle.slot;
+    sweepAndPrune.removeProxy(slot);
+    if (slot < treeProxies.size() && treeProxies[slot] != -1)
+    {
+        aabbTree.destroyProxy(treeProxies[slot]);
+        treeProxies[slot] = -1;
+    }
+
+    bodies.removeAt(index);
+    return true;
+}
+
+void PhysicsWorld::removeCirclesOutside(Rectangle area)
+{
+    for (int i = bodies.size() - 1; i >= 0; i--)
+    {
+        Vector2 position = bodies.position[i];
+        bool inside = position.x >= area.x && position.x <= area.x + area.width && position.y >= area.y && position.y <= area.y + area.height;
+        if (!inside)
+        {
+            removeCircle(bodies.handleAt(i));
+        }
+    }
+}
+
+void PhysicsWorld::reserve(int capacity)
+{
+    // Circles in a packed pile touch three others each on average, the rest is room for bounds
+    // that overlap without touching
+    int pairCapacity = capacity * 4;
+    bodies.reserve(capacity);
+    treeProxies.reserve(capacity);
+    treeQueries.reserve(capacity);
+    spatialHash.reserve(capacity);
+    sweepAndPrune.reserve(capacity, pairCapacity);
+    aabbTree.reserve(capacity);
+    // The tree pairs up fat boxes, which overlap several times more often than the circles touch.
+    // Fast bodies stretch theirs over the motion they expect, and a spray of them peaks at about 36
+    // pairs per body.
+    candidatePairs.reserve(capacity * 48);
+
+    // The per-step scratch sized by the body count, so spawning up to capacity does not grow it
+    contacts.reserve(pairCapacity);
+    planeContacts.reserve(capacity);
+    contactScratch.reserve(pairCapacity);
+    contactOffsets.reserve(capacity + 1);
+    planeSeparations.reserve(capacity);
+    islandParent.reserve(capacity);
+    islandSleepTime.reserve(capacity);
+    islandIds.reserve(capacity);
+    sweptCenters.reserve(capacity);
+    sweptRadii.reserve(capacity);
+    sweptBodies.reserve(capacity);
+    impactTimes.reserve(capacity);
+    impacts.reserve(capacity);
+    solver.reserve(capacity, pairCapacity + capacity);
+}
+
+bool PhysicsWorld::setBullet(BodyHandle handle, bool bullet)
+{
+    int index = bodies.indexOf(handle);
+    if (index == -1) return false;
+
+    if (bullet)
+        bodies.flags[index] |= BODY_BULLET;
+    else
+        bodies.flags[index] &= ~BODY_BULLET;
+    return true;
+}
+
+void PhysicsWorld::ResetNetForce()
+{
+    PROFILE_ZONE("ResetNetForce");
+    Vector2* forces = bodies.force.data();
+    jobs.parallelFor(bodies.size(), BODY_GRAIN, [=](int begin, int end)
+    {
+        std::fill(forces + begin, forces + end, Vector2{ 0,0 });
+    });
+}
+
+// The per-body stages run in parallel over disjoint ranges, each range through the SIMD kernels.
+// The debug recorder is not thread safe, so overlays are recorded in a separate serial pass, only
+// when enabled.
+void PhysicsWorld::AddGravityForce()
+{
+    PROFILE_ZONE("AddGravityForce");
+    const BodyKernels& kernels = GetBodyKernels(kernelLevel);
+    jobs.parallelFor(bodies.size(), BODY_GRAIN, [&](int begin, int end)
+    {
+        kernels.addGravity(bodies.force.data() + begin, bodies.mass.data() + begin, bodies.flags.data() + begin, BODY_INACTIVE, end - begin, accelerationGravity);
+    });
+
+    if (debugDraw.isEnabled(DEBUG_DRAW_GRAVITY))
+    {
+        for (int i = 0; i < bodies.size(); i++)
+        {
+            if (!IsAwake(bodies.flags[i])) continue;
+            debugDraw.arrow(DEBUG_DRAW_GRAVITY, bodies.position[i], bodies.position[i] + accelerationGravity * bodies.mass[i], 1, PURPLE);
+        }
+    }
+}
+
+void PhysicsWorld::ApplyForces()
+{
+    PROFILE_ZONE("ApplyForces");
+    int count = bodies.size();
+    const BodyKernels& kernels = GetBodyKernels(kernelLevel);
+    jobs.parallelFor(count, BODY_GRAIN, [&](int begin, int end)
+    {
+        kernels.applyForces(bodies.velocity.data() + begin, bodies.force.data() + begin, bodies.invMass.data() + begin, bodies.flags.data() + begin, BODY_INACTIVE, end - begin, substepDt);
+    });
+
+    if (debugDraw.isEnabled(DEBUG_DRAW_NET_FORCE))
+    {
+        for (int i = 0; i < count; i++)
+        {
+            if (!IsAwake(bodies.flags[i])) continue;
+            debugDraw.arrow(DEBUG_DRAW_NET_FORCE, bodies.position[i], bodies.position[i] + bodies.force[i], 4, GRAY);
+        }
+    }
+}
+
+void PhysicsWorld::ApplyKinematics()
+{
+    PROFILE_ZONE("ApplyKinematics");
+    int count = bodies.size();
+    const BodyKernels& kernels = GetBodyKernels(kernelLevel);
+    jobs.parallelFor(count, BODY_GRAIN, [&](int begin, int end)
+    {
+        kernels.integratePositions(bodies.position.data() + begin, bodies.velocity.data() + begin, bodies.flags.data() + begin, BODY_INACTIVE, end - begin, substepDt);
+    });
+    stepStats.bodiesIntegrated += (int)std::count_if(bodies.flags.begin(), bodies.flags.end(), IsAwake);
+
+    // Swept bodies that hit something end the step there instead
+    for (int i = 0; i < impacts.size(); i++)
+    {
+        bodies.position[impacts[i].body] = impacts[i].position;
+    }
+    impacts.clear();
+}
+
+// Once per step, after the last substep. The tree only does work for bodies that left their fat box.
+void PhysicsWorld::refitTree()
+{
+    PROFILE_ZONE("refitTree");
+    if (broadPhase == AABB_TREE)
+    {
+        for (int i = 0; i < bodies.size(); i++)
+        {
+            int slot = bodies.slotOf[i];
+            if (!IsAwake(bodies.flags[i]) || slot >= treeProxies.size() || treeProxies[slot] == -1) continue;
+            aabbTree.moveProxy(treeProxies[slot], circleBounds(i), bodies.velocity[i] * dt);
+        }
+    }
+
+    aabbTreeInSync = broadPhase == AABB_TREE;
+    sweepAndPruneInSync = broadPhase == SWEEP_AND_PRUNE;
+}
+
+PhysicsCircle PhysicsWorld::pickCircle(Vector2 point)
+{
+    PhysicsCircle picked;
+    auto testCircle = [&](int index)
+    {
+        if (Vector2Distance(point, bodies.position[index]) > bodies.radius[index]) return true;
+
+        picked.bodies = &bodies;
+        picked.handle = bodies.handleAt(index);
+        return false;
+    };
+
+    if (aabbTreeInSync)
+    {
+        aabbTree.query({ point.x, point.y, point.x, point.y }, [&](int slot)
+        {
+            return testCircle(bodies.slotIndex[slot]);
+        });
+    }
+    else
+    {
+        for (int i = 0; i < bodies.size(); i++)
+        {
+            if (!testCircle(i)) break;
+        }
+    }
+    return picked;
+}
+
+void PhysicsWorld::update()
+{
+    PROFILE_ZONE("Step");
+    Clock::time_point mark = Clock::now();
+    stepStats = StepStats();
+    long long allocationsBefore = AllocationCount();
+    // Only the overlay of the latest step is kept
+    debugDraw.clear();
+    // Bodies only rest under the gravity they settled in
+    if (accelerationGravity.x != lastGravity.x || accelerationGravity.y != lastGravity.y)
+    {
+        wakeAll();
+        lastGravity = accelerationGravity;
+    }
+    substeps = std::max(substeps, 1);
+    substepDt = dt / substeps;
+    ResetNetForce();
+    timings.resetNetForce += Lap(mark);
+    AddGravityForce();
+    timings.gravity += Lap(mark);
+
+    // The forces hold for the whole step and the pairs found on the first substep are reused by
+    // the others, everything else runs once per substep
+    for (int substep = 0; substep < substeps; substep++)
+    {
+        mark = Clock::now();
+        ApplyForces();
+        timings.kinematics += Lap(mark);
+        // checkCollisions() times its own stages
+        checkCollisions(substep > 0);
+        mark = Clock::now();
+        ApplyKinematics();
+        timings.kinematics += Lap(mark);
+        timings.substeps++;
+    }
+
+    refitTree();
+    timings.broadPhase += Lap(mark);
+    updateSleeping();
+    timings.sleeping += Lap(mark);
+    timings.steps++;
+    stepStats.allocations = AllocationCount() - allocationsBefore;
+
+    PROFILE_COUNTER("bodies", bodies.size());
+    PROFILE_COUNTER("pairs tested", pairsTested);
+    PROFILE_COUNTER("contacts", solver.getConstraintCount());
+}
+
+void PhysicsWorld::resetTimings()
+{
+    timings = StageTimings();
+}
+
+void PhysicsWorld::checkCollisions(bool reusePairs)
+{
+    PROFILE_ZONE("checkCollisions");
+    Clock::time_point mark = Clock::now();
+    std::fill(bodies.color.begin(), bodies.color.end(), GREEN);
+
+    collideHalfspaces();
+    timings.halfspaces += Lap(mark);
+
+    // Sleeping bodies only ever collide with an awake one, so with none awake there is nothing to
+    // find. The persistent broad-phases have nothing to catch up on either, as nothing moved.
+    bool anyAwake = std::any_of(bodies.flags.begin(), bodies.flags.end(), IsAwake);
+
+    // The reference path has no separate broad-phase, all of it counts as narrow-phase
+    if (!anyAwake)
+    {
+        candidatePairs.clear();
+        contacts.clear();
+        pairsTested = 0;
+    }
+    else if (broadPhase == BRUTE_FORCE)
+    {
+        if (!reusePairs) findSweptBodies();
+        collideAllPairs();
+    }
+    else
+    {
+        if (!reusePairs)
+        {
+            findSweptBodies();
+            if (broadPhase == SPATIAL_HASH)
+                findPairsSpatialHash();
+            else if (broadPhase == SWEEP_AND_PRUNE)
+                findPairsSweepAndPrune();
+            else
+                findPairsAabbTree();
+        }
+        timings.broadPhase += Lap(mark);
+
+        collideCandidatePairs();
+    }
+    wakeTouchedIslands();
+    timings.narrowPhase += Lap(mark);
+
+    solveContacts();
+    timings.solver += Lap(mark);
+
+    sweepFastBodies();
+    timings.continuous += Lap(mark);
+}
+
+// Reference path, tests every pair of circles without building a pair list. Like the pairs from
+// the broad-phases, circles only collide when their bounds for the step overlap. That always holds
+// for circles that touch, except on the later substeps, where a body may have left its bounds.
+void PhysicsWorld::collideAllPairs()
+{
+    PROFILE_ZONE("collideAllPairs");
+    candidatePairs.clear();
+
+    int count = bodies.size();
+    pairsTested = (int)((long long)count * (count - 1) / 2);
+
+    prepareContactBuffers();
+    std::atomic<int> narrowTests{ 0 };
+    jobs.parallelFor(count, ROW_GRAIN, [this, count, &narrowTests](int begin, int end)
+    {
+        std::vector<Contact>& buffer = contactBuffers[JobSystem::currentWorker()];
+        Contact contact;
+        int tests = 0;
+        for (int i = begin; i < end; i++)
+        {
+            for (int j = i + 1; j < count; j++)
+            {
+                if (!IsAwake(bodies.flags[i]) && !IsAwake(bodies.flags[j])) continue;
+                bool inSlotOrder = bodies.slotOf[i] < bodies.slotOf[j];
+                tests++;
+                if (CircleCircleContact(bodies, inSlotOrder ? i : j, inSlotOrder ? j : i, contact) && AabbOverlap(sweptBounds(i), sweptBounds(j))) buffer.push_back(contact);
+            }
+        }
+        narrowTests.fetch_add(tests, std::memory_order_relaxed);
+    });
+    stepStats.narrowTests += narrowTests;
+    gatherContacts(contacts);
+    sortContacts(contacts, false);
+}
+
+// Circles are binned into the grid and only pairs sharing a cell reach the narrow phase. Sleeping
+// and static circles stay in the resting layer between steps, so they are not binned again.
+void PhysicsWorld::findPairsSpatialHash()
+{
+    PROFILE_ZONE("findPairsSpatialHash");
+    if (restingChanged)
+    {
+        spatialHash.clearResting();
+        for (int i = 0; i < bodies.size(); i++)
+        {
+            if (!IsAwake(bodies.flags[i])) spatialHash.insertResting(i, bodies.position[i], bodies.radius[i]);
+        }
+        restingChanged = false;
+    }
+
+    spatialHash.clear();
+    for (int i = 0; i < bodies.size(); i++)
+    {
+        if (IsAwake(bodies.flags[i])) spatialHash.insert(i, sweptCenters[i], sweptRadii[i]);
+    }
+
+    spatialHash.findPairs(candidatePairs);
+}
+
+// The sorted endpoint lists persist between updates, so a settled pile only costs a pass over
+// nearly sorted data and the pair list changes through begin/end events. Proxies are keyed by
+// slot, which stays the same while bodies are moved around by removals. Sleeping and static
+// circles do not move, so once their proxies are in place they are left alone.
+void PhysicsWorld::findPairsSweepAndPrune()
+{
+    PROFILE_ZONE("findPairsSweepAndPrune");
+    for (int i = 0; i < bodies.size(); i++)
+    {
+        int slot = bodies.slotOf[i];
+        if (sweepAndPruneInSync && !IsAwake(bodies.flags[i]) && sweepAndPrune.hasProxy(slot)) continue;
+        sweepAndPrune.setProxy(slot, sweptCenters[i], sweptRadii[i]);
+    }
+    sweepAndPruneInSync = true;
+
+    sweepAndPrune.update();
+
+    pairsBegun = 0;
+    pairsEnded = 0;
+    for (int i = 0; i < sweepAndPrune.events.size(); i++)
+    {
+        if (sweepAndPrune.events[i].began)
+            pairsBegun++;
+        else
+            pairsEnded++;
+    }
+    sweepAndPrune.events.clear();
+
+    // Pairs of two resting bodies stay in the list, but never need testing
+    candidatePairs.clear();
+    for (int i = 0; i < sweepAndPrune.pairs.size(); i++)
+    {
+        int a = bodies.slotIndex[sweepAndPrune.pairs[i].a];
+        int b = bodies.slotIndex[sweepAndPrune.pairs[i].b];
+        if (IsAwake(bodies.flags[a]) || IsAwake(bodies.flags[b])) candidatePairs.push_back({ a, b });
+    }
+}
+
+// Leaves are created on first sight and afterwards only moved by refitTree(), once per step after
+// the last substep rather than from ApplyKinematics, which runs every substep. If another
+// broad-phase ran in between, every leaf is checked against its fat box once to catch up. Swept
+// bodies are checked every step, as their bounds grow with their speed. Only awake circles query
+// the tree, sleeping and static ones are just found by them.
+void PhysicsWorld::findPairsAabbTree()
+{
+    PROFILE_ZONE("findPairsAabbTree");
+    if (treeProxies.size() < bodies.slotCount()) treeProxies.resize(bodies.slotCount(), -1);
+
+    treeQueries.clear();
+    for (int i = 0; i < bodies.size(); i++)
+    {
+        int slot = bodies.slotOf[i];
+        if (treeProxies[slot] == -1)
+            treeProxies[slot] = aabbTree.createProxy(slot, sweptBounds(i));
+        else if (!aabbTreeInSync)
+            aabbTree.moveProxy(treeProxies[slot], sweptBounds(i), { 0,0 });
+        else if (sweptRadii[i] > bodies.radius[i])
+            aabbTree.moveProxy(treeProxies[slot], sweptBounds(i), bodies.velocity[i] * dt);
+
+        if (IsAwake(bodies.flags[i])) treeQueries.push_back(treeProxies[slot]);
+    }
+    aabbTreeInSync = true;
+
+    aabbTree.findPairs(treeQueries, candidatePairs);
+    for (int i = 0; i < candidatePairs.size(); i++)
+    {
+        candidatePairs[i] = { bodies.slotIndex[candidatePairs[i].a], bodies.slotIndex[candidatePairs[i].b] };
+    }
+}
+
+// Bounds of the circle around the body's path over the step, the same as circleBounds() unless it
+// is swept
+Aabb PhysicsWorld::sweptBounds(int index) const
+{
+    Vector2 center = sweptCenters[index];
+    float radius = sweptRadii[index];
+    return { center.x - radius, center.y - radius, center.x + radius, center.y + radius };
+}
+
+Aabb PhysicsWorld::circleBounds(int index) const
+{
+    Vector2 position = bodies.position[index];
+    float radius = bodies.radius[index];
+    return { position.x - radius, position.y - radius, position.x + radius, position.y + radius };
+}
+
+// Contact generation only reads the bodies, so the pair list is split across the job system with
+// each worker appending to its own buffer. The buffers are merged and sorted before resolution.
+//
+// Most candidate pairs do not touch, so each range first goes through the pair filter, which only
+// does the squared distance test, and contacts are built for the pairs that pass.
+void PhysicsWorld::collideCandidatePairs()
+{
+    PROFILE_ZONE("collideCandidatePairs");
+    pairsTested = (int)candidatePairs.size();
+
+    prepareContactBuffers();
+    overlapBuffers.resize(contactBuffers.size());
+    for (int i = 0; i < overlapBuffers.size(); i++)
+    {
+        overlapBuffers[i].reserve(candidatePairs.capacity());
+    }
+    std::atomic<int> narrowTests{ 0 };
+    jobs.parallelFor((int)candidatePairs.size(), PAIR_GRAIN, [&](int begin, int end)
+    {
+        int worker = JobSystem::currentWorker();
+        std::vector<Contact>& buffer = contactBuffers[worker];
+        std::vector<int>& overlapping = overlapBuffers[worker];
+        overlapping.resize(end - begin);
+        int overlapCount = OverlappingPairs(candidatePairs.data() + begin, end - begin, bodies.position.data(), bodies.radius.data(), overlapping.data());
+
+        Contact contact;
+        int tests = 0;
+        for (int k = 0; k < overlapCount; k++)
+        {
+            int i = begin + overlapping[k];
+            int a = candidatePairs[i].a;
+            int b = candidatePairs[i].b;
+            if (!IsAwake(bodies.flags[a]) && !IsAwake(bodies.flags[b])) continue;
+            if (bodies.slotOf[a] > bodies.slotOf[b]) std::swap(a, b);
+            tests++;
+            if (CircleCircleContact(bodies, a, b, contact) && AabbOverlap(sweptBounds(a), sweptBounds(b))) buffer.push_back(contact);
+        }
+        narrowTests.fetch_add(tests, std::memory_order_relaxed);
+    });
+    stepStats.narrowTests += narrowTests;
+    gatherContacts(contacts);
+    sortContacts(contacts, false);
+}
+
+// A worker may end up with every contact of the step, so each buffer is kept as large as the merged
+// list and none of them grows in the middle of a step
+void PhysicsWorld::prepareContactBuffers()
+{
+    contactBuffers.resize(jobs.getThreadCount());
+    for (int i = 0; i < contactBuffers.size(); i++)
+    {
+        contactBuffers[i].clear();
+        contactBuffers[i].reserve(contacts.capacity());
+    }
+}
+
+void PhysicsWorld::gatherContacts(std::vector<Contact>& gathered)
+{
+    gathered.clear();
+    for (int i = 0; i < contactBuffers.size(); i++)
+    {
+        gathered.insert(gathered.end(), contactBuffers[i].begin(), contactBuffers[i].end());
+    }
+}
+
+// Circle contacts are ordered by the slots of (a, b) and plane contacts by (plane, slot). Slots do
+// not move when other bodies are removed, so this is also the key order the solver's impulse cache
+// is kept in.
+void PhysicsWorld::sortContacts(std::vector<Contact>& sorted, bool byPlane)
+{
+    if (sorted.size() < 2) return;
+
+    const int* slotOf = bodies.slotOf.data();
+    int slotCount = bodies.slotCount();
+    int planeCount = (int)planes.size();
+    auto bySlotA = [slotOf](const Contact& contact) { return slotOf[contact.a]; };
+    auto bySlotB = [slotOf](const Contact& contact) { return slotOf[contact.b]; };
+    auto byPlaneB = [](const Contact& contact) { return contact.b; };
+    if (byPlane)
+    {
+        CountingSort(sorted, contactScratch, contactOffsets, slotCount, bySlotA);
+        CountingSort(sorted, contactScratch, contactOffsets, planeCount, byPlaneB);
+    }
+    else
+    {
+        CountingSort(sorted, contactScratch, contactOffsets, slotCount, bySlotB);
+        CountingSort(sorted, contactScratch, contactOffsets, slotCount, bySlotA);
+    }
+}
+
+void PhysicsWorld::solveContacts()
+{
+    PROFILE_ZONE("solveContacts");
+    solver.prepare(bodies, contacts, planeContacts, planes, coefficientOfFriction, substepDt);
+    solver.solve(bodies, jobs);
+    stepStats.candidatePairs += pairsTested;
+    stepStats.contacts += (int)contacts.size();
+    stepStats.halfspaceContacts += (int)planeContacts.size();
+    if (solver.getConstraintCount() > 0) stepStats.solverIterations += solver.iterations;
+    solver.finish(bodies, substepDt, debugDraw);
+
+    for (int i = 0; i < contacts.size(); i++)
+    {
+        bodies.color[contacts[i].a] = RED;
+        bodies.color[contacts[i].b] = RED;
+    }
+    for (int i = 0; i < planeContacts.size(); i++)
+    {
+        bodies.color[planeContacts[i].a] = RED;
+        halfspaces[planeContacts[i].b]->color = RED;
+    }
+}
+
+// Contacts between sleeping bodies are never generated, so an island woken here misses its inner
+// contacts for this step and picks them up on the next one
+void PhysicsWorld::wakeTouchedIslands()
+{
+    for (int i = 0; i < contacts.size(); i++)
+    {
+        const Contact& contact = contacts[i];
+        if (bodies.flags[contact.a] & BODY_SLEEPING) wakeIsland(bodies.island[contact.a]);
+        if (bodies.flags[contact.b] & BODY_SLEEPING) wakeIsland(bodies.island[contact.b]);
+    }
+}
+
+// Islands are not kept as lists, waking one is a scan for its id. It only happens when something
+// lands on a pile, which is rare next to the steps the pile spends asleep.
+void PhysicsWorld::wakeIsland(int island)
+{
+    if (island == -1) return;
+
+    for (int i = 0; i < bodies.size(); i++)
+    {
+        if (bodies.island[i] != island) continue;
+        bodies.flags[i] &= ~BODY_SLEEPING;
+        bodies.sleepTime[i] = 0;
+        bodies.island[i] = -1;
+    }
+    restingChanged = true;
+}
+
+void PhysicsWorld::wakeAll()
+{
+    for (int i = 0; i < bodies.size(); i++)
+    {
+        bodies.flags[i] &= ~BODY_SLEEPING;
+        bodies.sleepTime[i] = 0;
+        bodies.island[i] = -1;
+    }
+    sleepingCount = 0;
+    restingChanged = true;
+}
+
+void PhysicsWorld::updateSleeping()
+{
+    PROFILE_ZONE("updateSleeping");
+    int count = bodies.size();
+    if (!sleepingEnabled)
+    {
+        if (sleepingCount > 0) wakeAll();
+        awakeCount = (int)std::count_if(bodies.flags.begin(), bodies.flags.end(), IsAwake);
+        return;
+    }
+
+    // Union-find over the contacts between awake bodies. Halfspaces and static circles do not join
+    // islands, or everything resting on the ground would be one island.
+    islandParent.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        islandParent[i] = i;
+    }
+    for (int i = 0; i < contacts.size(); i++)
+    {
+        const Contact& contact = contacts[i];
+        if (!IsAwake(bodies.flags[contact.a]) || !IsAwake(bodies.flags[contact.b])) continue;
+
+        int rootA = findIsland(contact.a);
+        int rootB = findIsland(contact.b);
+        if (rootA != rootB) islandParent[std::max(rootA, rootB)] = std::min(rootA, rootB);
+    }
+
+    // An island has been resting as long as its most restless body
+    float sleepSpeedSquared = sleepSpeed * sleepSpeed;
+    islandSleepTime.assign(count, FLT_MAX);
+    for (int i = 0; i < count; i++)
+    {
+        if (!IsAwake(bodies.flags[i])) continue;
+
+        if (Vector2LengthSqr(bodies.velocity[i]) < sleepSpeedSquared)
+            bodies.sleepTime[i] += dt;
+        else
+            bodies.sleepTime[i] = 0;
+
+        int root = findIsland(i);
+        islandSleepTime[root] = fminf(islandSleepTime[root], bodies.sleepTime[i]);
+    }
+
+    islandIds.assign(count, -1);
+    awakeCount = 0;
+    sleepingCount = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (bodies.flags[i] & BODY_STATIC) continue;
+
+        if (IsAwake(bodies.flags[i]))
+        {
+            int root = findIsland(i);
+            if (islandSleepTime[root] < timeToSleep)
+            {
+                awakeCount++;
+                continue;
+            }
+
+            if (islandIds[root] == -1) islandIds[root] = nextIslandId++;
+            bodies.flags[i] |= BODY_SLEEPING;
+            bodies.island[i] = islandIds[root];
+            restingChanged = true;
+            bodies.velocity[i] = { 0,0 };
+        }
+        sleepingCount++;
+        bodies.color[i] = DARKGRAY;
+    }
+}
+
+// With path halving, so repeated lookups flatten the tree
+int PhysicsWorld::findIsland(int body)
+{
+    while (islandParent[body] != body)
+    {
+        islandParent[body] = islandParent[islandParent[body]];
+        body = islandParent[body];
+    }
+    return body;
+}
+
+// Halfspaces are infinite so no broad-phase can cull them. Instead every circle is tested
+// against every plane in one pass before the pair pipeline: the signed distances are computed
+// in a straight loop, and circles with a negative distance become contacts, which are solved
+// together with the circle contacts.
+void PhysicsWorld::collideHalfspaces()
+{
+    PROFILE_ZONE("collideHalfspaces");
+    planes.clear();
+    for (int i = 0; i < halfspaces.size(); i++)
+    {
+        PhysicsHalfspace* halfspace = halfspaces[i];
+        halfspace->color = GREEN;
+        planes.push_back({ halfspace->position, halfspace->getNormal(), halfspace->bounciness });
+    }
+
+    // A plane that moved may have left sleeping bodies in the air
+    bool planesChanged = planes.size() != lastPlanes.size();
+    for (int i = 0; i < planes.size() && !planesChanged; i++)
+    {
+        planesChanged = planes[i].point.x != lastPlanes[i].point.x || planes[i].point.y != lastPlanes[i].point.y || planes[i].normal.x != lastPlanes[i].normal.x || planes[i].normal.y != lastPlanes[i].normal.y || planes[i].bounciness != lastPlanes[i].bounciness;
+    }
+    if (planesChanged)
+    {
+        wakeAll();
+        lastPlanes = planes;
+    }
+
+    int count = bodies.size();
+    planeSeparations.resize(count);
+    const Vector2* positions = bodies.position.data();
+    const float* radii = bodies.radius.data();
+    const unsigned char* flags = bodies.flags.data();
+    float* separations = planeSeparations.data();
+
+    prepareContactBuffers();
+    for (int p = 0; p < planes.size(); p++)
+    {
+        HalfspacePlane plane = planes[p];
+
+        jobs.parallelFor(count, BODY_GRAIN, [=](int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+            {
+                separations[i] = (positions[i].x - plane.point.x) * plane.normal.x + (positions[i].y - plane.point.y) * plane.normal.y - radii[i];
+            }
+
+            std::vector<Contact>& buffer = contactBuffers[JobSystem::currentWorker()];
+            for (int i = begin; i < end; i++)
+            {
+                if (separations[i] < 0 && !(flags[i] & BODY_INACTIVE)) buffer.push_back({ i, p, plane.normal, -separations[i] });
+            }
+        });
+    }
+    gatherContacts(planeContacts);
+    sortContacts(planeContacts, true);
+}
+
+// Fast bodies and bullets go into the broad-phase as the circle around their whole path over the
+// step, so the candidate pairs already hold what they can reach. With substeps every awake body
+// does, as the pairs have to last the whole step, and gravity still adds to the velocities.
+void PhysicsWorld::findSweptBodies()
+{
+    PROFILE_ZONE("findSweptBodies");
+    int count = bodies.size();
+    sweptCenters.resize(count);
+    sweptRadii.resize(count);
+    float fall = substeps > 1 ? 0.5f * Vector2Length(accelerationGravity) * dt * dt + substepMargin : 0.0f;
+    for (int i = 0; i < count; i++)
+    {
+        sweptCenters[i] = bodies.position[i];
+        sweptRadii[i] = bodies.radius[i];
+        if (!IsAwake(bodies.flags[i])) continue;
+        if (substeps == 1 && !(continuousCollision && isSwept(i))) continue;
+
+        Vector2 motion = bodies.velocity[i] * dt;
+        sweptCenters[i] += motion * 0.5f;
+        sweptRadii[i] += Vector2Length(motion) * (0.5f + sweptMargin) + fall;
+    }
+}
+
+bool PhysicsWorld::isSwept(int index) const
+{
+    if (!IsAwake(bodies.flags[index])) return false;
+    if (bodies.flags[index] & BODY_BULLET) return true;
+    float radius = bodies.radius[index];
+    return Vector2LengthSqr(bodies.velocity[index]) * (substepDt * substepDt) > radius * radius;
+}
+
+// Runs after the solver, on the velocities the bodies are about to move with, so bodies the solver
+// made fast are swept too. A body stops at its earliest impact, just inside the contact, and keeps
+// its velocity so the solver bounces it on the next step. A slow body that gets hit moves its whole
+// step and overlaps by less than its radius at most.
+//
+// Swept bodies are tested against what their bounds overlapped in the broad-phase. Bodies whose
+// motion now reaches past those bounds, because the solver sped them up, are rare and tested
+// against every body. Both sets are the same whatever the broad-phase, and so are the impacts.
+void PhysicsWorld::sweepFastBodies()
+{
+    PROFILE_ZONE("sweepFastBodies");
+    impacts.clear();
+    sweptBodies.clear();
+    if (continuousCollision)
+    {
+        for (int i = 0; i < bodies.size(); i++)
+        {
+            if (isSwept(i)) sweptBodies.push_back(i);
+        }
+    }
+    sweptCount = (int)sweptBodies.size();
+    impactCount = 0;
+    if (sweptBodies.empty()) return;
+
+    // Above 1 for the bodies that are not swept
+    impactTimes.assign(bodies.size(), 2.0f);
+    for (int i = 0; i < sweptBodies.size(); i++)
+    {
+        impactTimes[sweptBodies[i]] = 1.0f;
+    }
+
+    if (broadPhase == BRUTE_FORCE)
+    {
+        for (int i = 0; i < sweptBodies.size(); i++)
+        {
+            int body = sweptBodies[i];
+            Aabb bounds = sweptBounds(body);
+            for (int other = 0; other < bodies.size(); other++)
+            {
+                if (other != body && AabbOverlap(bounds, sweptBounds(other))) sweepPair(body, other);
+            }
+        }
+    }
+    else
+    {
+        for (int i = 0; i < candidatePairs.size(); i++)
+        {
+            int a = candidatePairs[i].a;
+            int b = candidatePairs[i].b;
+            if (impactTimes[a] > 1 && impactTimes[b] > 1) continue;
+            if (AabbOverlap(sweptBounds(a), sweptBounds(b))) sweepPair(a, b);
+        }
+    }
+
+    for (int i = 0; i < sweptBodies.size(); i++)
+    {
+        // Still inside its bounds when both ends of its path are
+        int body = sweptBodies[i];
+        Vector2 start = bodies.position[body];
+        Vector2 end = start + bodies.velocity[body] * substepDt;
+        float inside = sweptRadii[body] - bodies.radius[body];
+        if (Vector2Distance(start, sweptCenters[body]) <= inside && Vector2Distance(end, sweptCenters[body]) <= inside) continue;
+
+        for (int other = 0; other < bodies.size(); other++)
+        {
+            if (other != body) sweepPair(body, other);
+        }
+    }
+
+    for (int i = 0; i < sweptBodies.size(); i++)
+    {
+        int body = sweptBodies[i];
+        Vector2 position = bodies.position[body];
+        Vector2 motion = bodies.velocity[body] * substepDt;
+        float time = impactTimes[body];
+
+        // Distance to the contact along the normal over how much of it this step's motion covers
+        for (int p = 0; p < planes.size(); p++)
+        {
+            float separation = Vector2DotProduct(position - planes[p].point, planes[p].normal) - bodies.radius[body] + sweptContactDepth;
+            float approach = -Vector2DotProduct(motion, planes[p].normal);
+            if (separation > 0 && approach > separation) time = fminf(time, separation / approach);
+        }
+
+        if (time < 1)
+        {
+            impacts.push_back({ body, position + motion * time });
+            impactCount++;
+        }
+    }
+}
+
+void PhysicsWorld::sweepPair(int a, int b)
+{
+    float time = circleImpactTime(a, b);
+    if (impactTimes[a] <= 1) impactTimes[a] = fminf(impactTimes[a], time);
+    if (impactTimes[b] <= 1) impactTimes[b] = fminf(impactTimes[b], time);
+}
+
+// Fraction of the step after which the circles come within sweptContactDepth of touching, or 1
+// when they do not. Circles already that close and still closing in do not move at all, the solver
+// did not manage to stop them.
+float PhysicsWorld::circleImpactTime(int a, int b) const
+{
+    // Solves |offset + motion * t| = distance for the first t, with the quadratic's b halved
+    Vector2 offset = bodies.position[b] - bodies.position[a];
+    Vector2 motion = (bodies.velocity[b] - bodies.velocity[a]) * substepDt;
+    float distance = bodies.radius[a] + bodies.radius[b] - sweptContactDepth;
+    float linear = Vector2DotProduct(offset, motion);
+    if (linear >= 0) return 1;
+
+    float constant = Vector2LengthSqr(offset) - distance * distance;
+    if (constant <= 0) return 0;
+
+    float quadratic = Vector2LengthSqr(motion);
+    float discriminant = linear * linear - quadratic * constant;
+    if (discriminant < 0) return 1;
+
+    float time = (-linear - sqrtf(discriminant)) / quadratic;
+    return fminf(time, 1.0f);
+}
+
+bool CircleCircleOverlap(const BodyStore& bodies, int a, int b)
+{
+    Vector2 displacementFromAToB = bodies.position[b] - bodies.position[a];
+    float distance = Vector2Length(displacementFromAToB);
+    float sumOfRadius = bodies.radius[a] + bodies.radius[b];
+
+    if (sumOfRadius > distance)
+    {
+        return true;
+    }
+    else
+        return false;
+}
+
+bool CircleCircleContact(const BodyStore& bodies, int a, int b, Contact& contact)
+{
+    Vector2 displacementFromAToB = bodies.position[b] - bodies.position[a];
+    float sumOfRadius = bodies.radius[a] + bodies.radius[b];
+    float distanceSquared = Vector2LengthSqr(displacementFromAToB);
+    if (distanceSquared > sumOfRadius * sumOfRadius) return false;
+
+    float distance = sqrtf(distanceSquared);
+    contact.a = a;
+    contact.b = b;
+    contact.depth = sumOfRadius - distance;
+    // Coincident centers have no direction, push them apart vertically
+    contact.normal = distance > 0.0001f ? displacementFromAToB / distance : Vector2{ 0, -1 };
+    return true;
+}
+
+bool CircleHalfspaceOverlap(const BodyStore& bodies, int circle, PhysicsHalfspace* halfspace, DebugDraw& debugDraw)
+{
+    Vector2 position = bodies.position[circle];
+    float radius = bodies.radius[circle];
+    Vector2 displacementToCircle = position - halfspace->position;
+    float dot = Vector2DotProduct(displacementToCircle, halfspace->getNormal());
+    Vector2 vectorProjection = halfspace->getNormal() * dot;
+
+    bool isOverlapping = dot <= radius && dot >= -radius;
+    if (debugDraw.isEnabled(DEBUG_DRAW_NORMAL))
+    {
+        debugDraw.line(DEBUG_DRAW_NORMAL, position, position - vectorProjection, 1, GRAY);
+        Vector2 midpoint = position - vectorProjection * 0.5f;
+        debugDraw.text(DEBUG_DRAW_NORMAL, midpoint, 30, GRAY, "D: %6.0f", dot);
+    }
+
+    return isOverlapping;
+}
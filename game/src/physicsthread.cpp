@@ -0,0 +1,293 @@
+#include "physicsthread.h"
+#include "profiler.h"
+#include <chrono>
+
+bool operator==(const PhysicsSettings& a, const PhysicsSettings& b)
+{
+    for (int i = 0; i < DEBUG_DRAW_CATEGORY_COUNT; i++)
+    {
+        if (a.debugDraw[i] != b.debugDraw[i]) return false;
+    }
+    return a.gravity.x == b.gravity.x && a.gravity.y == b.gravity.y
+        && a.friction == b.friction
+        && a.halfspacePosition.x == b.halfspacePosition.x && a.halfspacePosition.y == b.halfspacePosition.y
+        && a.halfspaceRotation == b.halfspaceRotation
+        && a.broadPhase == b.broadPhase
+        && a.cellSize == b.cellSize
+        && a.physicsRate == b.physicsRate
+        && a.substeps == b.substeps
+        && a.threads == b.threads
+        && a.solverIterations == b.solverIterations
+        && a.warmStarting == b.warmStarting
+        && a.sleeping == b.sleeping
+        && a.continuousCollision == b.continuousCollision
+        && a.keepArea.x == b.keepArea.x && a.keepArea.y == b.keepArea.y
+        && a.keepArea.width == b.keepArea.width && a.keepArea.height == b.keepArea.height;
+}
+
+bool operator!=(const PhysicsSettings& a, const PhysicsSettings& b)
+{
+    return !(a == b);
+}
+
+double PhysicsClock()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+float RenderSnapshot::interpolationAlpha() const
+{
+    if (dt <= 0) return 1;
+    return Clamp((float)((PhysicsClock() - stepTime) / dt), 0, 1);
+}
+
+PhysicsSettings CaptureSettings(const PhysicsWorld& world)
+{
+    PhysicsSettings settings;
+    settings.gravity = world.accelerationGravity;
+    settings.friction = world.coefficientOfFriction;
+    if (!world.halfspaces.empty())
+    {
+        settings.halfspacePosition = world.halfspaces[0]->position;
+        settings.halfspaceRotation = world.halfspaces[0]->getRotation();
+    }
+    settings.broadPhase = world.broadPhase;
+    settings.cellSize = world.spatialHash.cellSize;
+    settings.physicsRate = 1.0f / world.dt;
+    settings.substeps = world.substeps;
+    settings.threads = world.jobs.getThreadCount();
+    settings.solverIterations = world.solver.iterations;
+    settings.warmStarting = world.solver.warmStarting;
+    settings.sleeping = world.sleepingEnabled;
+    settings.continuousCollision = world.continuousCollision;
+    for (int i = 0; i < DEBUG_DRAW_CATEGORY_COUNT; i++)
+    {
+        settings.debugDraw[i] = world.debugDraw.enabled[i];
+    }
+    return settings;
+}
+
+PhysicsThread::PhysicsThread(PhysicsWorld& world) : world(world)
+{
+}
+
+PhysicsThread::~PhysicsThread()
+{
+    stop();
+}
+
+void PhysicsThread::start()
+{
+    if (running) return;
+    physicsRate = 1.0f / world.dt;
+    // Something to draw before the first step is done
+    recordPositions();
+    stepTime = PhysicsClock();
+    publish();
+    running = true;
+    thread = std::thread(&PhysicsThread::run, this);
+}
+
+void PhysicsThread::stop()
+{
+    running = false;
+    if (thread.joinable()) thread.join();
+}
+
+bool PhysicsThread::send(const PhysicsCommand& command)
+{
+    return commands.push(command);
+}
+
+const RenderSnapshot& PhysicsThread::latestSnapshot()
+{
+    snapshots.update();
+    return snapshots.front();
+}
+
+void PhysicsThread::run()
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point nextStep = Clock::now();
+    Clock::time_point secondStart = nextStep;
+    int stepsThisSecond = 0;
+
+    while (running)
+    {
+        PhysicsCommand command;
+        while (commands.pop(command))
+        {
+            apply(command);
+        }
+
+        if (stepLimit > 0 && step >= stepLimit)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        Clock::duration stepLength = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(world.dt));
+        Clock::time_point now = Clock::now();
+        if (realTime)
+        {
+            if (now < nextStep)
+            {
+                std::this_thread::sleep_until(nextStep);
+                continue;
+            }
+            // Too far behind: drop the backlog instead of running flat out to catch up
+            if (now - nextStep > stepLength * maxCatchUpSteps) nextStep = now;
+            stepTime = std::chrono::duration<double>(nextStep.time_since_epoch()).count();
+            nextStep += stepLength;
+        }
+        else
+        {
+            stepTime = std::chrono::duration<double>(now.time_since_epoch()).count();
+        }
+
+        recordPositions();
+        world.update();
+        if (keepArea.width > 0 && keepArea.height > 0) world.removeCirclesOutside(keepArea);
+        simulationTime += world.dt;
+        step++;
+
+        stepsThisSecond++;
+        now = Clock::now();
+        double elapsed = std::chrono::duration<double>(now - secondStart).count();
+        if (elapsed >= 1.0)
+        {
+            stepsPerSecond = (float)(stepsThisSecond / elapsed);
+            stepsThisSecond = 0;
+            secondStart = now;
+        }
+
+        const StageTimings& timings = world.timings;
+        if (timings.steps >= (int)physicsRate)
+        {
+            double perStep = timings.resetNetForce + timings.gravity + timings.broadPhase + timings.sleeping;
+            double perSubstep = timings.halfspaces + timings.narrowPhase + timings.solver + timings.continuous + timings.kinematics;
+            msPerStep = perStep * 1000.0 / timings.steps;
+            msPerSubstep = perSubstep * 1000.0 / timings.substeps;
+            if (world.broadPhase == AABB_TREE) treeAreaRatio = world.aabbTree.getAreaRatio();
+            world.resetTimings();
+        }
+
+        publish();
+        ProfilerFlush("Physics");
+    }
+}
+
+void PhysicsThread::apply(const PhysicsCommand& command)
+{
+    switch (command.type)
+    {
+    case COMMAND_SPAWN_CIRCLE:
+    {
+        PhysicsCircle circle = world.addCircle(command.position, command.velocity, command.radius, command.mass, command.bounciness);
+        world.setBullet(circle.handle, command.bullet);
+        break;
+    }
+    case COMMAND_SETTINGS:
+        applySettings(command.settings);
+        break;
+    }
+}
+
+void PhysicsThread::applySettings(const PhysicsSettings& settings)
+{
+    world.accelerationGravity = settings.gravity;
+    world.coefficientOfFriction = settings.friction;
+    if (!world.halfspaces.empty())
+    {
+        world.halfspaces[0]->position = settings.halfspacePosition;
+        world.halfspaces[0]->setRotationDegrees(settings.halfspaceRotation);
+    }
+    world.broadPhase = settings.broadPhase;
+    world.spatialHash.cellSize = settings.cellSize;
+    physicsRate = settings.physicsRate;
+    world.dt = 1.0f / physicsRate;
+    if (settings.substeps != world.substeps)
+    {
+        world.substeps = settings.substeps;
+        world.resetTimings();
+    }
+    world.jobs.setThreadCount(settings.threads);
+    world.solver.iterations = settings.solverIterations;
+    world.solver.warmStarting = settings.warmStarting;
+    world.sleepingEnabled = settings.sleeping;
+    world.continuousCollision = settings.continuousCollision;
+    for (int i = 0; i < DEBUG_DRAW_CATEGORY_COUNT; i++)
+    {
+        world.debugDraw.enabled[i] = settings.debugDraw[i];
+    }
+    keepArea = settings.keepArea;
+}
+
+void PhysicsThread::recordPositions()
+{
+    const BodyStore& bodies = world.bodies;
+    slotPositions.resize(bodies.slotCount());
+    slotGenerations.resize(bodies.slotCount());
+    for (int i = 0; i < bodies.size(); i++)
+    {
+        int slot = bodies.slotOf[i];
+        slotPositions[slot] = bodies.position[i];
+        slotGenerations[slot] = bodies.slotGeneration[slot];
+    }
+}
+
+void PhysicsThread::publish()
+{
+    RenderSnapshot& snapshot = snapshots.back();
+    const BodyStore& bodies = world.bodies;
+
+    // assign() keeps the capacity each buffer has grown to, so this stops allocating
+    snapshot.position.assign(bodies.position.begin(), bodies.position.end());
+    snapshot.velocity.assign(bodies.velocity.begin(), bodies.velocity.end());
+    snapshot.radius.assign(bodies.radius.begin(), bodies.radius.end());
+    snapshot.color.assign(bodies.color.begin(), bodies.color.end());
+    snapshot.serial.assign(bodies.serial.begin(), bodies.serial.end());
+    // Looked up by slot, the step and the despawning after it move bodies around the dense arrays
+    snapshot.previousPosition.resize(bodies.size());
+    for (int i = 0; i < bodies.size(); i++)
+    {
+        int slot = bodies.slotOf[i];
+        bool recorded = slot < (int)slotGenerations.size() && slotGenerations[slot] == bodies.slotGeneration[slot];
+        snapshot.previousPosition[i] = recorded ? slotPositions[slot] : bodies.position[i];
+    }
+
+    snapshot.halfspaces.clear();
+    for (int i = 0; i < world.halfspaces.size(); i++)
+    {
+        PhysicsHalfspace* halfspace = world.halfspaces[i];
+        snapshot.halfspaces.push_back({ halfspace->position, halfspace->getNormal(), halfspace->color });
+    }
+    snapshot.debugDraw = world.debugDraw;
+
+    snapshot.step = step;
+    snapshot.simulationTime = simulationTime;
+    snapshot.stepTime = stepTime;
+    snapshot.dt = world.dt;
+    snapshot.stepsPerSecond = stepsPerSecond;
+    snapshot.msPerStep = msPerStep;
+    snapshot.msPerSubstep = msPerSubstep;
+
+    snapshot.pairsTested = world.pairsTested;
+    snapshot.pairsBegun = world.pairsBegun;
+    snapshot.pairsEnded = world.pairsEnded;
+    snapshot.treeHeight = world.aabbTree.getHeight();
+    snapshot.treeNodes = world.aabbTree.getNodeCount();
+    snapshot.treeAreaRatio = treeAreaRatio;
+    snapshot.contacts = world.solver.getConstraintCount();
+    snapshot.warmStarted = world.solver.getWarmStartedCount();
+    snapshot.colors = world.solver.getColorCount();
+    snapshot.largestBatch = world.solver.getBatchSizes().empty() ? 0 : world.solver.getBatchSizes()[0];
+    snapshot.overflow = world.solver.getOverflowCount();
+    snapshot.awake = world.awakeCount;
+    snapshot.asleep = world.sleepingCount;
+    snapshot.swept = world.sweptCount;
+    snapshot.impacts = world.impactCount;
+    snapshot.stats = world.stepStats;
+
+    snapshots.publish();
+}
@@ -0,0 +1,380 @@
+#include "profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Events a thread can record between two flushes before the oldest are overwritten
+static const int RING_CAPACITY = 1 << 12;
+
+// Written only by the thread that owns it
+struct ThreadRing
+{
+    struct ZoneTotal
+    {
+        const char* name;
+        int depth;
+        long long firstStart;
+        long long nanoseconds;
+    };
+
+    std::vector<ProfileEvent> events;
+    long long head = 0;
+    long long flushed = 0;
+    // Events before this one went to a capture already, or were recorded before it started
+    long long collected = 0;
+    // Trace thread id, assigned on first use
+    int id = -1;
+    int depth = 0;
+    long long lastFlush = 0;
+    std::vector<ZoneTotal> totals;
+};
+
+static thread_local ThreadRing Ring;
+
+struct ZoneHistory
+{
+    const char* name;
+    int depth;
+    float ms[PROFILER_HISTORY];
+};
+
+struct ThreadHistory
+{
+    std::string name;
+    std::vector<ZoneHistory> zones;
+    float frameMs[PROFILER_HISTORY] = {};
+    long long frames = 0;
+    long long lost = 0;
+};
+
+static std::mutex HistoryMutex;
+static std::vector<std::unique_ptr<ThreadHistory>> Histories;
+
+struct CapturedEvent
+{
+    ProfileEvent event;
+    int thread;
+};
+
+struct Capture
+{
+    std::string path;
+    long long start = 0;
+    std::vector<CapturedEvent> events;
+    // Trace thread id and name of every thread that handed events over
+    std::vector<std::pair<int, std::string>> threads;
+};
+
+static std::atomic<int> NextThreadId{ 0 };
+// Set while a capture runs, so threads that are not capturing only pay for one load per flush
+static std::atomic<bool> Capturing{ false };
+static std::atomic<int> TracesWritten{ 0 };
+// Guards the capture, its owner and frame count, and the writer
+static std::mutex CaptureMutex;
+static Capture CurrentCapture;
+#if PROFILER_ENABLED
+static std::thread::id CaptureOwner;
+static int CaptureFramesLeft = 0;
+#endif
+static std::thread Writer;
+
+long long ProfilerNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ProfileZone::ProfileZone(const char* name) : name(name), start(ProfilerNow()), depth(Ring.depth++)
+{
+}
+
+void ProfilerInitThread()
+{
+#if PROFILER_ENABLED
+    if (Ring.events.empty()) Ring.events.resize(RING_CAPACITY);
+#endif
+}
+
+static void Record(ThreadRing& ring, const ProfileEvent& event)
+{
+    if (ring.events.empty()) ring.events.resize(RING_CAPACITY);
+    ring.events[ring.head & (RING_CAPACITY - 1)] = event;
+    ring.head++;
+}
+
+ProfileZone::~ProfileZone()
+{
+    long long end = ProfilerNow();
+    ThreadRing& ring = Ring;
+    ring.depth--;
+    Record(ring, { name, start, end, depth, 0 });
+}
+
+void ProfilerCounter(const char* name, double value)
+{
+    long long now = ProfilerNow();
+    Record(Ring, { name, now, now, PROFILE_COUNTER_DEPTH, value });
+}
+
+#if PROFILER_ENABLED
+// Copies the events recorded since the last call into the running capture, if there is one
+static void CollectEvents(ThreadRing& ring, const char* threadName)
+{
+    if (!Capturing.load(std::memory_order_acquire))
+    {
+        ring.collected = ring.head;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(CaptureMutex);
+    if (!Capturing.load(std::memory_order_relaxed)) return;
+    if (ring.id == -1) ring.id = NextThreadId++;
+
+    Capture& capture = CurrentCapture;
+    bool known = false;
+    for (const std::pair<int, std::string>& thread : capture.threads)
+    {
+        if (thread.first == ring.id) known = true;
+    }
+    if (!known) capture.threads.push_back({ ring.id, threadName });
+
+    long long first = std::max(ring.collected, ring.head - RING_CAPACITY);
+    for (long long i = first; i < ring.head; i++)
+    {
+        const ProfileEvent& event = ring.events[i & (RING_CAPACITY - 1)];
+        if (event.start >= capture.start) capture.events.push_back({ event, ring.id });
+    }
+    ring.collected = ring.head;
+}
+#endif
+
+void ProfilerCollect(const char* threadName)
+{
+#if PROFILER_ENABLED
+    CollectEvents(Ring, threadName);
+#else
+    (void)threadName;
+#endif
+}
+
+#if PROFILER_ENABLED
+static void WriteTrace(Capture capture)
+{
+    FILE* file = fopen(capture.path.c_str(), "w");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "could not write trace %s\n", capture.path.c_str());
+        return;
+    }
+
+    // Microseconds from the start of the capture, one process, a track per thread
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (const std::pair<int, std::string>& thread : capture.threads)
+    {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", thread.first, thread.second.c_str());
+        first = false;
+    }
+    for (const CapturedEvent& captured : capture.events)
+    {
+        const ProfileEvent& event = captured.event;
+        double start = (event.start - capture.start) * 1e-3;
+        if (event.depth == PROFILE_COUNTER_DEPTH)
+        {
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"value\":%g}}", first ? "" : ",\n", event.name, start, captured.thread, event.value);
+        }
+        else
+        {
+            double duration = (event.end - event.start) * 1e-3;
+            fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"depth\":%d}}", first ? "" : ",\n", event.name, start, duration, captured.thread, event.depth);
+        }
+        first = false;
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    TracesWritten++;
+}
+
+// Counts down the capture on the thread that started it and hands it to the writer at the end
+static void EndCaptureFrame()
+{
+    if (!Capturing.load(std::memory_order_acquire)) return;
+
+    std::lock_guard<std::mutex> lock(CaptureMutex);
+    if (!Capturing.load(std::memory_order_relaxed) || CaptureOwner != std::this_thread::get_id()) return;
+    if (--CaptureFramesLeft > 0) return;
+
+    Capturing.store(false, std::memory_order_release);
+    if (Writer.joinable()) Writer.join();
+    Writer = std::thread(WriteTrace, std::move(CurrentCapture));
+    CurrentCapture = Capture();
+}
+#endif
+
+bool ProfilerStartCapture(int frames, const std::string& path)
+{
+#if PROFILER_ENABLED
+    std::lock_guard<std::mutex> lock(CaptureMutex);
+    if (Capturing.load(std::memory_order_relaxed)) return false;
+
+    CurrentCapture = Capture();
+    CurrentCapture.path = path;
+    CurrentCapture.start = ProfilerNow();
+    CaptureOwner = std::this_thread::get_id();
+    CaptureFramesLeft = std::max(frames, 1);
+    Capturing.store(true, std::memory_order_release);
+    return true;
+#else
+    (void)frames;
+    (void)path;
+    return false;
+#endif
+}
+
+bool ProfilerCapturing()
+{
+    return Capturing.load(std::memory_order_relaxed);
+}
+
+int ProfilerTracesWritten()
+{
+    return TracesWritten.load();
+}
+
+void ProfilerFinishWrites()
+{
+    std::thread writer;
+    {
+        std::lock_guard<std::mutex> lock(CaptureMutex);
+        writer = std::move(Writer);
+    }
+    if (writer.joinable()) writer.join();
+}
+
+void ProfilerFlush(const char* threadName)
+{
+#if PROFILER_ENABLED
+    ThreadRing& ring = Ring;
+    long long now = ProfilerNow();
+    float frameMs = ring.lastFlush != 0 ? (float)((now - ring.lastFlush) * 1e-6) : 0.0f;
+    ring.lastFlush = now;
+
+    // Summed per zone before taking the lock, so the lock is held for a few dozen entries at most
+    long long first = std::max(ring.flushed, ring.head - RING_CAPACITY);
+    long long lost = first - ring.flushed;
+    ring.totals.clear();
+    for (long long i = first; i < ring.head; i++)
+    {
+        const ProfileEvent& event = ring.events[i & (RING_CAPACITY - 1)];
+        if (event.depth == PROFILE_COUNTER_DEPTH) continue;
+        ThreadRing::ZoneTotal* total = nullptr;
+        for (ThreadRing::ZoneTotal& candidate : ring.totals)
+        {
+            if (candidate.name == event.name) total = &candidate;
+        }
+        if (total == nullptr)
+        {
+            ring.totals.push_back({ event.name, event.depth, event.start, 0 });
+            total = &ring.totals.back();
+        }
+        total->firstStart = std::min(total->firstStart, event.start);
+        total->nanoseconds += event.end - event.start;
+    }
+    ring.flushed = ring.head;
+    // Events are recorded as zones end, children before their parent. New zones are listed in the
+    // order they started instead, so a parent comes before its children.
+    std::sort(ring.totals.begin(), ring.totals.end(), [](const ThreadRing::ZoneTotal& a, const ThreadRing::ZoneTotal& b)
+    {
+        return a.firstStart < b.firstStart;
+    });
+
+    CollectEvents(ring, threadName);
+    EndCaptureFrame();
+
+    std::lock_guard<std::mutex> lock(HistoryMutex);
+    ThreadHistory* history = nullptr;
+    for (std::unique_ptr<ThreadHistory>& candidate : Histories)
+    {
+        if (candidate->name == threadName) history = candidate.get();
+    }
+    if (history == nullptr)
+    {
+        Histories.push_back(std::make_unique<ThreadHistory>());
+        history = Histories.back().get();
+        history->name = threadName;
+    }
+
+    int slot = (int)(history->frames % PROFILER_HISTORY);
+    for (ZoneHistory& zone : history->zones)
+    {
+        zone.ms[slot] = 0;
+    }
+    for (const ThreadRing::ZoneTotal& total : ring.totals)
+    {
+        ZoneHistory* zone = nullptr;
+        for (ZoneHistory& candidate : history->zones)
+        {
+            if (candidate.name == total.name) zone = &candidate;
+        }
+        if (zone == nullptr)
+        {
+            history->zones.push_back({ total.name, total.depth, {} });
+            zone = &history->zones.back();
+        }
+        zone->ms[slot] = (float)(total.nanoseconds * 1e-6);
+    }
+    history->frameMs[slot] = frameMs;
+    history->frames++;
+    history->lost += lost;
+#else
+    (void)threadName;
+#endif
+}
+
+void ProfilerGetStats(std::vector<ProfileThreadStats>& stats)
+{
+    std::lock_guard<std::mutex> lock(HistoryMutex);
+    stats.resize(Histories.size());
+    for (int i = 0; i < Histories.size(); i++)
+    {
+        const ThreadHistory& history = *Histories[i];
+        ProfileThreadStats& thread = stats[i];
+        int count = (int)std::min<long long>(history.frames, PROFILER_HISTORY);
+        // Oldest first: once the history is full the oldest frame is the one about to be overwritten
+        int oldest = history.frames > PROFILER_HISTORY ? (int)(history.frames % PROFILER_HISTORY) : 0;
+
+        thread.name = history.name;
+        thread.lost = history.lost;
+        thread.frameMs.resize(count);
+        thread.meanFrameMs = 0;
+        thread.maxFrameMs = 0;
+        for (int j = 0; j < count; j++)
+        {
+            float ms = history.frameMs[(oldest + j) % PROFILER_HISTORY];
+            thread.frameMs[j] = ms;
+            thread.meanFrameMs += ms;
+            thread.maxFrameMs = std::max(thread.maxFrameMs, (double)ms);
+        }
+        if (count > 0) thread.meanFrameMs /= count;
+
+        thread.zones.resize(history.zones.size());
+        for (int j = 0; j < history.zones.size(); j++)
+        {
+            const ZoneHistory& zone = history.zones[j];
+            ProfileZoneStats& zoneStats = thread.zones[j];
+            zoneStats.name = zone.name;
+            zoneStats.depth = zone.depth;
+            zoneStats.meanMs = 0;
+            zoneStats.maxMs = 0;
+            for (int k = 0; k < count; k++)
+            {
+                zoneStats.meanMs += zone.ms[k];
+                zoneStats.maxMs = std::max(zoneStats.maxMs, (double)zone.ms[k]);
+            }
+            if (count > 0) zoneStats.meanMs /= count;
+        }
+    }
+}
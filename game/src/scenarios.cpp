@@ -0,0 +1,200 @@
+#include "scenarios.h"
+
+void Scenario::step()
+{
+    world.update();
+}
+
+PhysicsHalfspace* Scenario::addHalfspace(Vector2 position, float rotationDegrees, float bounciness)
+{
+    ownedHalfspaces.push_back(std::make_unique<PhysicsHalfspace>());
+    PhysicsHalfspace* halfspace = ownedHalfspaces.back().get();
+    halfspace->isStatic = true;
+    halfspace->position = position;
+    halfspace->bounciness = bounciness;
+    halfspace->setRotationDegrees(rotationDegrees);
+    world.add(halfspace);
+    return halfspace;
+}
+
+float Scenario::random(float min, float max)
+{
+    if (!seeded)
+    {
+        generator.seed(seed);
+        seeded = true;
+    }
+
+    // mt19937 output is fixed by the standard, the distributions are not, so scale it by hand to
+    // get the same bodies from every compiler
+    float unit = (float)(generator() / 4294967296.0);
+    return min + (max - min) * unit;
+}
+
+// Bodies dropped at random over a walled floor, from a band that grows with the body count so the
+// density at the start is roughly constant
+class RainScenario : public Scenario
+{
+public:
+    const char* getName() const override { return "rain"; }
+
+    void setup() override
+    {
+        world.accelerationGravity = { 0, 200 };
+        world.reserve(bodyCount);
+        addHalfspace({ 600, 800 }, 0, 0.8f);
+        addHalfspace({ 0, 800 }, 90, 0.8f);
+        addHalfspace({ 1200, 800 }, -90, 0.8f);
+
+        float bandHeight = fmaxf(400, bodyCount * 2.0f);
+        for (int i = 0; i < bodyCount; i++)
+        {
+            Vector2 position = { random(20, 1180), random(700 - bandHeight, 700) };
+            Vector2 velocity = { random(-20, 20), random(0, 50) };
+            world.addCircle(position, velocity, random(4, 10), 1, 0.5f);
+        }
+    }
+};
+
+// A packed grid of equal circles settling into a V formed by two rotated halfspaces, for the
+// dense resting-contact case
+class PileScenario : public Scenario
+{
+public:
+    const char* getName() const override { return "pile"; }
+
+    void setup() override
+    {
+        world.accelerationGravity = { 0, 200 };
+        world.reserve(bodyCount);
+        addHalfspace({ 600, 800 }, 30, 0.2f);
+        addHalfspace({ 600, 800 }, -30, 0.2f);
+
+        const float radius = 8;
+        const int columns = 60;
+        for (int i = 0; i < bodyCount; i++)
+        {
+            int column = i % columns;
+            int row = i / columns;
+            Vector2 position = { 600 + (column - columns * 0.5f) * radius * 2 + random(-1, 1), 600 - row * radius * 2 };
+            world.addCircle(position, { 0, 0 }, radius, 1, 0.2f);
+        }
+    }
+};
+
+// Small circles fired much faster than their radius per step from a nozzle on the left, into a
+// wall of static circles. Without continuous collision most of them pass straight through it.
+class SprayScenario : public Scenario
+{
+public:
+    const char* getName() const override { return "spray"; }
+
+    void setup() override
+    {
+        world.accelerationGravity = { 0, 200 };
+        world.reserve(bodyCount + wallCount);
+        addHalfspace({ 600, 800 }, 0, 0.5f);
+        addHalfspace({ 0, 800 }, 90, 0.5f);
+        addHalfspace({ 1200, 800 }, -90, 0.5f);
+
+        // Overlapping, so there is no gap to slip through between them
+        for (int i = 0; i < wallCount; i++)
+        {
+            world.addCircle({ wallX, 800 - i * 16.0f }, { 0, 0 }, 12, 0, 0.5f);
+        }
+        spawned = 0;
+    }
+
+    void step() override
+    {
+        for (int i = 0; i < perStep && spawned < bodyCount; i++, spawned++)
+        {
+            float angle = random(-0.15f, 0.05f);
+            float speed = random(1500, 2500);
+            Vector2 velocity = { speed * cosf(angle), speed * sinf(angle) };
+            world.addCircle({ 40, random(450, 650) }, velocity, random(3, 6), 1, 0.5f);
+        }
+        world.update();
+    }
+
+    int countTunneled() const override
+    {
+        int tunneled = 0;
+        for (int i = 0; i < world.bodies.size(); i++)
+        {
+            if (world.bodies.position[i].x > wallX && !(world.bodies.flags[i] & BODY_STATIC)) tunneled++;
+        }
+        return tunneled;
+    }
+
+private:
+    static constexpr float wallX = 800;
+    static const int wallCount = 80;
+    static const int perStep = 4;
+    int spawned = 0;
+};
+
+// Short towers of circles standing apart on a wide floor, with a bird dropped onto one of them
+// every few steps. Each tower is its own island and soon sleeps, so nearly every body is asleep and
+// the awake set is the few islands the birds have just hit.
+class FieldScenario : public Scenario
+{
+public:
+    const char* getName() const override { return "field"; }
+
+    void setup() override
+    {
+        world.accelerationGravity = { 0, 200 };
+        world.reserve(bodyCount + bodyCount / birdEvery + 1);
+        addHalfspace({ 600, 800 }, 0, 0.2f);
+
+        towers = (bodyCount + towerHeight - 1) / towerHeight;
+        for (int i = 0; i < bodyCount; i++)
+        {
+            int tower = i / towerHeight;
+            int level = i % towerHeight;
+            world.addCircle({ towerX(tower), 800 - radius - level * radius * 2 }, { 0, 0 }, radius, 1, 0.2f);
+        }
+        steps = 0;
+    }
+
+    void step() override
+    {
+        // Once the towers have had time to fall asleep
+        if (steps >= 50 && steps % birdEvery == 0)
+        {
+            float x = towerX((int)random(0, (float)towers)) + random(-radius, radius);
+            world.addCircle({ x, 800 - towerHeight * radius * 2 - 200 }, { 0, 300 }, radius, 1, 0.2f);
+        }
+        steps++;
+        world.update();
+    }
+
+private:
+    static constexpr float radius = 8;
+    static constexpr float spacing = 28;
+    static const int towerHeight = 4;
+    static const int birdEvery = 10;
+    int towers = 0;
+    int steps = 0;
+
+    static float towerX(int tower)
+    {
+        return 20 + tower * spacing;
+    }
+};
+
+std::unique_ptr<Scenario> CreateScenario(const std::string& name)
+{
+    if (name == "rain") return std::make_unique<RainScenario>();
+    if (name == "pile") return std::make_unique<PileScenario>();
+    if (name == "spray") return std::make_unique<SprayScenario>();
+    if (name == "field") return std::make_unique<FieldScenario>();
+    return nullptr;
+}
+
+const std::vector<std::string>& ScenarioNames()
+{
+    static const std::vector<std::string> names = { "rain", "pile", "spray", "field" };
+    return names;
+}
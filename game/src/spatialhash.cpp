@@ -0,0 +1,172 @@
+#include "spatialhash.h"
+#include <algorithm>
+#include <cmath>
+
+void SpatialHash::Layer::reserve(int count)
+{
+    proxies.reserve(count);
+    entries.reserve(count * 4);
+    sortedEntries.reserve(count * 4);
+    bucketStart.reserve(count * 16 + 1);
+}
+
+void SpatialHash::reserve(int count)
+{
+    moving.reserve(count);
+    resting.reserve(count);
+    bucketCursor.reserve(count * 16);
+}
+
+void SpatialHash::clear()
+{
+    moving.proxies.clear();
+    moving.entries.clear();
+}
+
+void SpatialHash::insert(int id, Vector2 center, float radius)
+{
+    moving.proxies.push_back({ id, { center.x - radius, center.y - radius, center.x + radius, center.y + radius } });
+    bin(moving, (int)moving.proxies.size() - 1);
+}
+
+void SpatialHash::clearResting()
+{
+    resting.proxies.clear();
+    resting.entries.clear();
+    restingCellSize = 0;
+}
+
+// Binned by the next findPairs(), once every resting body is in
+void SpatialHash::insertResting(int id, Vector2 center, float radius)
+{
+    resting.proxies.push_back({ id, { center.x - radius, center.y - radius, center.x + radius, center.y + radius } });
+    restingCellSize = 0;
+}
+
+void SpatialHash::findPairs(std::vector<CandidatePair>& pairs)
+{
+    pairs.clear();
+
+    // The resting layer keeps its bounds, so a new cell size only means binning them again
+    if (restingCellSize != cellSize)
+    {
+        resting.entries.clear();
+        for (int i = 0; i < resting.proxies.size(); i++)
+        {
+            bin(resting, i);
+        }
+        sort(resting);
+        restingCellSize = cellSize;
+    }
+
+    sort(moving);
+
+    for (unsigned int bucket = 0; bucket <= moving.bucketMask; bucket++)
+    {
+        int begin = moving.bucketStart[bucket];
+        int end = moving.bucketStart[bucket + 1];
+
+        for (int i = begin; i < end; i++)
+        {
+            const Entry& entryA = moving.sortedEntries[i];
+            const Proxy& proxyA = moving.proxies[entryA.proxy];
+
+            for (int j = i + 1; j < end; j++)
+            {
+                const Entry& entryB = moving.sortedEntries[j];
+                // Different cells can share a bucket
+                if (entryA.cell != entryB.cell) continue;
+                addPair(proxyA, moving.proxies[entryB.proxy], entryA.cell, pairs);
+            }
+
+            // The resting bodies in the same cell, looked up in the resting layer's own buckets
+            if (resting.entries.empty()) continue;
+            unsigned int restingBucket = bucketOf(entryA.cell, resting.bucketMask);
+            for (int j = resting.bucketStart[restingBucket]; j < resting.bucketStart[restingBucket + 1]; j++)
+            {
+                const Entry& entryB = resting.sortedEntries[j];
+                if (entryA.cell != entryB.cell) continue;
+                addPair(proxyA, resting.proxies[entryB.proxy], entryA.cell, pairs);
+            }
+        }
+    }
+}
+
+void SpatialHash::bin(Layer& layer, int proxyIndex)
+{
+    const Aabb& bounds = layer.proxies[proxyIndex].bounds;
+    int minCellX = cellCoordinate(bounds.minX);
+    int minCellY = cellCoordinate(bounds.minY);
+    int maxCellX = cellCoordinate(bounds.maxX);
+    int maxCellY = cellCoordinate(bounds.maxY);
+
+    for (int cellY = minCellY; cellY <= maxCellY; cellY++)
+    {
+        for (int cellX = minCellX; cellX <= maxCellX; cellX++)
+        {
+            layer.entries.push_back({ cellKey(cellX, cellY), proxyIndex });
+        }
+    }
+}
+
+// Counting sort of the entries by bucket
+void SpatialHash::sort(Layer& layer)
+{
+    unsigned int bucketCount = 1;
+    while (bucketCount < layer.entries.size() * 2) bucketCount <<= 1;
+    layer.bucketMask = bucketCount - 1;
+
+    layer.bucketStart.assign(bucketCount + 1, 0);
+    for (int i = 0; i < layer.entries.size(); i++)
+    {
+        layer.bucketStart[bucketOf(layer.entries[i].cell, layer.bucketMask) + 1]++;
+    }
+    for (unsigned int bucket = 0; bucket < bucketCount; bucket++)
+    {
+        layer.bucketStart[bucket + 1] += layer.bucketStart[bucket];
+    }
+
+    bucketCursor.assign(layer.bucketStart.begin(), layer.bucketStart.end() - 1);
+    layer.sortedEntries.resize(layer.entries.size());
+    for (int i = 0; i < layer.entries.size(); i++)
+    {
+        unsigned int bucket = bucketOf(layer.entries[i].cell, layer.bucketMask);
+        layer.sortedEntries[bucketCursor[bucket]++] = layer.entries[i];
+    }
+}
+
+void SpatialHash::addPair(const Proxy& proxyA, const Proxy& proxyB, unsigned long long cell, std::vector<CandidatePair>& pairs) const
+{
+    if (!AabbOverlap(proxyA.bounds, proxyB.bounds)) return;
+
+    // A pair sharing several cells is only reported from the cell holding the min corner of the
+    // overlap region, which removes duplicates without a set
+    int ownerX = cellCoordinate(std::max(proxyA.bounds.minX, proxyB.bounds.minX));
+    int ownerY = cellCoordinate(std::max(proxyA.bounds.minY, proxyB.bounds.minY));
+    if (cellKey(ownerX, ownerY) != cell) return;
+
+    if (proxyA.id < proxyB.id)
+        pairs.push_back({ proxyA.id, proxyB.id });
+    else
+        pairs.push_back({ proxyB.id, proxyA.id });
+}
+
+int SpatialHash::cellCoordinate(float value) const
+{
+    // Clamped so bodies that have flown far away (or gone NaN) still map to a valid cell
+    float cell = floorf(value / cellSize);
+    if (!(cell > -1e9f)) return -1000000000;
+    if (cell > 1e9f) return 1000000000;
+    return (int)cell;
+}
+
+unsigned long long SpatialHash::cellKey(int cellX, int cellY) const
+{
+    return ((unsigned long long)(unsigned int)cellX << 32) | (unsigned int)cellY;
+}
+
+unsigned int SpatialHash::bucketOf(unsigned long long cell, unsigned int bucketMask) const
+{
+    unsigned long long hash = cell * 0x9E3779B97F4A7C15ull;
+    return (unsigned int)(hash >> 32) & bucketMask;
+}
@@ -0,0 +1,364 @@
+#include "sweepandprune.h"
+#include <algorithm>
+#include <iterator>
+
+static unsigned int PairHash(unsigned long long key)
+{
+    return (unsigned int)((key * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+void SweepAndPrune::reserve(int proxyCount, int pairCount)
+{
+    proxies.reserve(proxyCount);
+    axes[0].reserve(proxyCount * 2);
+    axes[1].reserve(proxyCount * 2);
+    addedEndpoints.reserve(proxyCount * 2);
+    mergedEndpoints.reserve(proxyCount * 2);
+    moveBuffer.reserve(proxyCount);
+    activeAdded.reserve(proxyCount);
+    activeOld.reserve(proxyCount);
+    pairs.reserve(pairCount);
+    events.reserve(pairCount);
+
+    int capacity = 16;
+    while (capacity < pairCount * 2) capacity <<= 1;
+    if (capacity > pairTable.size()) rebuildPairTable(capacity);
+}
+
+void SweepAndPrune::setProxy(int id, Vector2 center, float radius)
+{
+    if (id >= proxies.size()) proxies.resize(id + 1);
+
+    // The id of a removed proxy may be reused before its endpoints were flushed
+    if (proxies[id].removed) flushRemovals();
+
+    Proxy& proxy = proxies[id];
+    Aabb bounds = { center.x - radius, center.y - radius, center.x + radius, center.y + radius };
+    if (proxy.active && bounds.minX == proxy.bounds.minX && bounds.minY == proxy.bounds.minY && bounds.maxX == proxy.bounds.maxX && bounds.maxY == proxy.bounds.maxY) return;
+    proxy.bounds = bounds;
+
+    // New proxies get their endpoints in the next update()
+    if (!proxy.active)
+    {
+        proxy.active = true;
+        proxy.added = true;
+    }
+
+    if (!proxy.moved)
+    {
+        proxy.moved = true;
+        moveBuffer.push_back(id);
+    }
+}
+
+void SweepAndPrune::removeProxy(int id)
+{
+    if (id >= proxies.size() || !proxies[id].active) return;
+
+    // Removal is deferred, so despawning many bodies in one step costs a single pass
+    proxies[id].active = false;
+    proxies[id].removed = true;
+    pendingRemovals++;
+}
+
+bool SweepAndPrune::hasProxy(int id) const
+{
+    return id < proxies.size() && proxies[id].active;
+}
+
+void SweepAndPrune::update()
+{
+    flushRemovals();
+
+    // One endpoint at a time, with the values of the others as they were. Every other endpoint is
+    // in order, so each one only has to be shifted past the ones it overtook.
+    int addedCount = 0;
+    for (int i = 0; i < moveBuffer.size(); i++)
+    {
+        Proxy& proxy = proxies[moveBuffer[i]];
+        proxy.moved = false;
+        if (!proxy.active) continue;
+        if (proxy.added)
+        {
+            moveBuffer[addedCount++] = moveBuffer[i];
+            continue;
+        }
+
+        moveEndpoint(0, proxy.minIndex[0], proxy.bounds.minX);
+        moveEndpoint(0, proxy.maxIndex[0], proxy.bounds.maxX);
+        moveEndpoint(1, proxy.minIndex[1], proxy.bounds.minY);
+        moveEndpoint(1, proxy.maxIndex[1], proxy.bounds.maxY);
+    }
+    moveBuffer.resize(addedCount);
+
+    if (!moveBuffer.empty()) insertAdded();
+    moveBuffer.clear();
+}
+
+// Shifting new endpoints in one at a time would cost a swap for every endpoint they pass, so they
+// are sorted on their own and merged in, and their pairs are then found in a single sweep
+void SweepAndPrune::insertAdded()
+{
+    for (int axis = 0; axis < 2; axis++)
+    {
+        addedEndpoints.clear();
+        for (int i = 0; i < moveBuffer.size(); i++)
+        {
+            int id = moveBuffer[i];
+            const Aabb& bounds = proxies[id].bounds;
+            addedEndpoints.push_back({ axis == 0 ? bounds.minX : bounds.minY, id, false });
+            addedEndpoints.push_back({ axis == 0 ? bounds.maxX : bounds.maxY, id, true });
+        }
+
+        auto sortsBefore = [](const Endpoint& a, const Endpoint& b) { return sortsAfter(b, a); };
+        std::sort(addedEndpoints.begin(), addedEndpoints.end(), sortsBefore);
+        mergedEndpoints.clear();
+        std::merge(axes[axis].begin(), axes[axis].end(), addedEndpoints.begin(), addedEndpoints.end(), std::back_inserter(mergedEndpoints), sortsBefore);
+        axes[axis].swap(mergedEndpoints);
+
+        for (int i = 0; i < axes[axis].size(); i++)
+        {
+            placeEndpoint(axis, axes[axis][i], i);
+        }
+    }
+
+    // One sweep along x, keeping the proxies whose interval is open split into new and old ones.
+    // A new proxy is tested against both, an old one only against the new ones, so only pairs with
+    // a new proxy in them are looked at and y is only compared for those that overlap on x.
+    activeAdded.clear();
+    activeOld.clear();
+    for (int i = 0; i < axes[0].size(); i++)
+    {
+        const Endpoint& endpoint = axes[0][i];
+        Proxy& proxy = proxies[endpoint.id];
+        std::vector<int>& active = proxy.added ? activeAdded : activeOld;
+
+        if (endpoint.isMax)
+        {
+            // Swap-remove, keeping the position of the moved proxy up to date
+            int last = active.back();
+            active[proxy.activeIndex] = last;
+            proxies[last].activeIndex = proxy.activeIndex;
+            active.pop_back();
+            continue;
+        }
+
+        for (int j = 0; j < activeAdded.size(); j++)
+        {
+            if (overlapping(endpoint.id, activeAdded[j], 1)) addPair(endpoint.id, activeAdded[j]);
+        }
+        if (proxy.added)
+        {
+            for (int j = 0; j < activeOld.size(); j++)
+            {
+                if (overlapping(endpoint.id, activeOld[j], 1)) addPair(endpoint.id, activeOld[j]);
+            }
+        }
+
+        proxy.activeIndex = (int)active.size();
+        active.push_back(endpoint.id);
+    }
+
+    for (int i = 0; i < moveBuffer.size(); i++)
+    {
+        proxies[moveBuffer[i]].added = false;
+    }
+}
+
+void SweepAndPrune::flushRemovals()
+{
+    if (pendingRemovals == 0) return;
+
+    auto isRemoved = [this](const Endpoint& endpoint) { return proxies[endpoint.id].removed; };
+    for (int axis = 0; axis < 2; axis++)
+    {
+        std::vector<Endpoint>& endpoints = axes[axis];
+        endpoints.erase(std::remove_if(endpoints.begin(), endpoints.end(), isRemoved), endpoints.end());
+        for (int i = 0; i < endpoints.size(); i++)
+        {
+            placeEndpoint(axis, endpoints[i], i);
+        }
+    }
+
+    int kept = 0;
+    for (int i = 0; i < pairs.size(); i++)
+    {
+        CandidatePair pair = pairs[i];
+        if (proxies[pair.a].removed || proxies[pair.b].removed)
+        {
+            events.push_back({ pair.a, pair.b, false });
+            continue;
+        }
+
+        pairs[kept++] = pair;
+    }
+    pairs.resize(kept);
+    // Most indices moved, so the table is refilled in place
+    rebuildPairTable((int)pairTable.size());
+
+    for (int i = 0; i < proxies.size(); i++)
+    {
+        proxies[i].removed = false;
+    }
+    pendingRemovals = 0;
+}
+
+void SweepAndPrune::moveEndpoint(int axis, int index, float value)
+{
+    std::vector<Endpoint>& endpoints = axes[axis];
+    endpoints[index].value = value;
+
+    // Moving down, a min passing another body's max starts an overlap on this axis and a max
+    // passing another body's min ends one. Moving up it is the other way around. Min/min and
+    // max/max swaps change nothing. Either way the pair only changes if the two also overlap on
+    // the other axis, which spares the pair table the lookups for everything else passed.
+    int otherAxis = 1 - axis;
+    int j = index;
+    while (j > 0 && sortsAfter(endpoints[j - 1], endpoints[j]))
+    {
+        swapEndpoints(axis, j - 1, j);
+        const Endpoint& endpoint = endpoints[j - 1];
+        const Endpoint& passed = endpoints[j];
+        if (passed.id != endpoint.id && passed.isMax != endpoint.isMax && overlapping(endpoint.id, passed.id, otherAxis))
+        {
+            if (!endpoint.isMax)
+                addPair(endpoint.id, passed.id);
+            else
+                removePair(endpoint.id, passed.id);
+        }
+        j--;
+    }
+    while (j + 1 < endpoints.size() && sortsAfter(endpoints[j], endpoints[j + 1]))
+    {
+        swapEndpoints(axis, j, j + 1);
+        const Endpoint& endpoint = endpoints[j + 1];
+        const Endpoint& passed = endpoints[j];
+        if (passed.id != endpoint.id && passed.isMax != endpoint.isMax && overlapping(endpoint.id, passed.id, otherAxis))
+        {
+            if (endpoint.isMax)
+                addPair(endpoint.id, passed.id);
+            else
+                removePair(endpoint.id, passed.id);
+        }
+        j++;
+    }
+}
+
+void SweepAndPrune::swapEndpoints(int axis, int indexA, int indexB)
+{
+    Endpoint endpoint = axes[axis][indexA];
+    placeEndpoint(axis, axes[axis][indexB], indexA);
+    placeEndpoint(axis, endpoint, indexB);
+}
+
+void SweepAndPrune::placeEndpoint(int axis, const Endpoint& endpoint, int index)
+{
+    axes[axis][index] = endpoint;
+    Proxy& proxy = proxies[endpoint.id];
+    if (endpoint.isMax)
+        proxy.maxIndex[axis] = index;
+    else
+        proxy.minIndex[axis] = index;
+}
+
+bool SweepAndPrune::sortsAfter(const Endpoint& a, const Endpoint& b)
+{
+    // On equal values a min sorts before a max, so touching boxes count as overlapping the same
+    // way AabbOverlap does
+    if (a.value != b.value) return a.value > b.value;
+    return a.isMax && !b.isMax;
+}
+
+// Compares where the endpoints are rather than the bounds, since proxies still waiting in the move
+// buffer have new bounds but old endpoints
+bool SweepAndPrune::overlapping(int idA, int idB, int axis) const
+{
+    const Proxy& a = proxies[idA];
+    const Proxy& b = proxies[idB];
+    return a.minIndex[axis] < b.maxIndex[axis] && b.minIndex[axis] < a.maxIndex[axis];
+}
+
+void SweepAndPrune::addPair(int idA, int idB)
+{
+    if (idA > idB) std::swap(idA, idB);
+
+    unsigned long long key = pairKey(idA, idB);
+    if (findPairSlot(key) != -1) return;
+
+    // Past the reserved size the table doubles, the way the vectors grow
+    if ((pairs.size() + 1) * 2 > pairTable.size()) rebuildPairTable(std::max(16, (int)pairTable.size() * 2));
+    insertPairSlot(key, (int)pairs.size());
+    pairs.push_back({ idA, idB });
+    events.push_back({ idA, idB, true });
+}
+
+void SweepAndPrune::removePair(int idA, int idB)
+{
+    if (idA > idB) std::swap(idA, idB);
+
+    int slot = findPairSlot(pairKey(idA, idB));
+    if (slot == -1) return;
+
+    // Swap-remove, keeping the index of the moved pair up to date
+    int index = pairTable[slot].index;
+    erasePairSlot(slot);
+    if (index != pairs.size() - 1)
+    {
+        pairs[index] = pairs.back();
+        pairTable[findPairSlot(pairKey(pairs[index].a, pairs[index].b))].index = index;
+    }
+    pairs.pop_back();
+    events.push_back({ idA, idB, false });
+}
+
+unsigned long long SweepAndPrune::pairKey(int idA, int idB)
+{
+    return ((unsigned long long)(unsigned int)idA << 32) | (unsigned int)idB;
+}
+
+int SweepAndPrune::findPairSlot(unsigned long long key) const
+{
+    if (pairTable.empty()) return -1;
+
+    unsigned int mask = (unsigned int)pairTable.size() - 1;
+    for (unsigned int slot = PairHash(key) & mask;; slot = (slot + 1) & mask)
+    {
+        if (pairTable[slot].key == key) return (int)slot;
+        if (pairTable[slot].key == EMPTY_KEY) return -1;
+    }
+}
+
+void SweepAndPrune::insertPairSlot(unsigned long long key, int index)
+{
+    unsigned int mask = (unsigned int)pairTable.size() - 1;
+    unsigned int slot = PairHash(key) & mask;
+    while (pairTable[slot].key != EMPTY_KEY) slot = (slot + 1) & mask;
+    pairTable[slot] = { key, index };
+}
+
+void SweepAndPrune::erasePairSlot(int slot)
+{
+    // Backward shift instead of tombstones: entries further along the probe run move into the
+    // hole when it lies between their home slot and where they are, so lookups stay short
+    unsigned int mask = (unsigned int)pairTable.size() - 1;
+    unsigned int hole = (unsigned int)slot;
+    for (unsigned int next = (hole + 1) & mask; pairTable[next].key != EMPTY_KEY; next = (next + 1) & mask)
+    {
+        unsigned int home = PairHash(pairTable[next].key) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            pairTable[hole] = pairTable[next];
+            hole = next;
+        }
+    }
+    pairTable[hole].key = EMPTY_KEY;
+}
+
+void SweepAndPrune::rebuildPairTable(int capacity)
+{
+    pairTable.assign(capacity, { EMPTY_KEY, -1 });
+    for (int i = 0; i < pairs.size(); i++)
+    {
+        insertPairSlot(pairKey(pairs[i].a, pairs[i].b), i);
+    }
+}